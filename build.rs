@@ -38,7 +38,6 @@ fn main() {
     println!("cargo:rustc-link-search=native={}", out_dir);
     println!("cargo:rustc-link-lib=dylib=toiya");
 
-    println!("cargo:rerun-if-changed=src/toiya-hyperapi/src/reader_sample.cpp");
-    println!("cargo:rerun-if-changed=src/toiya-hyperapi/src/reader_sample.hpp");
+    println!("cargo:rerun-if-changed=src/toiya-hyperapi/src");
     println!("cargo:rerun-if-changed=src/toiya-hyperapi/CMakeLists.txt");
 }
\ No newline at end of file
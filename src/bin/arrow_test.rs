@@ -1,6 +1,16 @@
-use toiya::ffi::arrow::read_from_hyper;
+use toiya::ffi::arrow::{read_from_hyper, ReadOptions};
 
 fn main() {
-    let res = read_from_hyper("/Users/seigooshima/git-private/toiya/src/toiya-hyperapi/src/data/train.hyper", 2000);
-    println!("{:?}", res);
-}
\ No newline at end of file
+    let options = ReadOptions { chunk_size: 2000, ..Default::default() };
+    let reader = read_from_hyper(
+        "/Users/seigooshima/git-private/toiya/src/toiya-hyperapi/src/data/train.hyper",
+        "SELECT * FROM spaceship",
+        &options,
+    )
+    .expect("Failed to read from hyper");
+
+    for batch in reader {
+        let batch = batch.expect("Failed to read record batch");
+        println!("Columns: {}, Rows: {}", batch.num_columns(), batch.num_rows());
+    }
+}
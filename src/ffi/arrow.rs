@@ -1,53 +1,151 @@
-use std::ffi::CString;
-use arrow::array::{RecordBatch, RecordBatchReader};
-use arrow::compute::concat_batches;
+use std::error::Error;
+use std::ffi::{c_char, c_int, c_void, CStr, CString};
+use std::fmt;
+use std::mem::MaybeUninit;
+use std::ptr;
+use std::time::Duration;
+
 use arrow::ffi_stream::{ArrowArrayStreamReader, FFI_ArrowArrayStream};
 
+// Mirrors of the declarations in src/toiya-hyperapi/src/toiya.h. ToiyaReadOptions
+// has to match field for field, toiya_read_options_init writes all of it.
+const TOIYA_OK: c_int = 0;
+
 #[repr(C)]
-struct CResult {
-    data: *mut std::ffi::c_void,
-    name: *const std::ffi::c_char,
-    release: unsafe extern "C" fn(data: *mut std::ffi::c_void),
+struct ToiyaError {
+    code: c_int,
+    message: [c_char; 1024],
 }
 
+#[repr(C)]
+struct ToiyaReadOptions {
+    struct_size: usize,
+    chunk_size: usize,
+    target_batch_bytes: usize,
+    buffer_pool_bytes: usize,
+    allocator: *const c_void,
+    not_null_columns: *const *const c_char,
+    not_null_column_count: usize,
+    nullability_table: *const c_char,
+    hyper_path: *const c_char,
+    timeout_ms: u64,
+    cache_dir: *const c_char,
+    cache_max_bytes: u64,
+    compute_statistics: c_int,
+    single_batch: c_int,
+}
 
-extern "C"{
-    fn read_from_hyper_query_c(
-        path: *const std::ffi::c_char,
-        query: *const std::ffi::c_char,
-        chunk_size: usize,
-    ) -> CResult;
+#[repr(C)]
+struct ToiyaStream {
+    _private: [u8; 0],
 }
 
+extern "C" {
+    fn toiya_read_options_init(options: *mut ToiyaReadOptions);
 
-pub fn read_from_hyper(path: &str, chunk_size: usize) -> Result<RecordBatch, Box<dyn std::error::Error>> {
-    unsafe {
-        let path = CString::new(path).unwrap();
-        let query = CString::new("SELECT * FROM spaceship").unwrap();
-        let result = read_from_hyper_query_c(path.as_ptr(), query.as_ptr(), chunk_size);
+    fn toiya_stream_open(
+        path: *const c_char,
+        query: *const c_char,
+        options: *const ToiyaReadOptions,
+        out: *mut *mut ToiyaStream,
+        error: *mut ToiyaError,
+    ) -> c_int;
 
-        if result.data.is_null() {
-            return Err("Failed to read from hyper".into());
+    fn toiya_stream_export(
+        stream: *mut ToiyaStream,
+        out: *mut FFI_ArrowArrayStream,
+        error: *mut ToiyaError,
+    ) -> c_int;
+
+    fn toiya_stream_free(stream: *mut ToiyaStream);
+}
+
+#[derive(Debug)]
+pub struct HyperError {
+    pub code: i32,
+    pub message: String,
+}
+
+impl fmt::Display for HyperError {
+    fn fmt(&self, f: &mut fmt::Formatter<'_>) -> fmt::Result {
+        write!(f, "toiya error {}: {}", self.code, self.message)
+    }
+}
+
+impl Error for HyperError {}
+
+impl From<ToiyaError> for HyperError {
+    fn from(error: ToiyaError) -> Self {
+        let message = unsafe { CStr::from_ptr(error.message.as_ptr()) };
+        HyperError {
+            code: error.code,
+            message: message.to_string_lossy().into_owned(),
         }
+    }
+}
 
-        let stream_ptr = result.data as *mut FFI_ArrowArrayStream;
-        let mut stream_reader = ArrowArrayStreamReader::from_raw(stream_ptr)
-            .expect("Failed to create ArrowArrayStreamReader");
+#[derive(Debug, Clone, Default)]
+pub struct ReadOptions {
+    /// Rows per Hyper chunk. 0 keeps Hyper's default chunking.
+    pub chunk_size: usize,
+    /// When non-zero, batches are sized to land near this many bytes.
+    pub target_batch_bytes: usize,
+    /// Result columns known to be NOT NULL.
+    pub not_null_columns: Vec<String>,
+    /// Cancels the query when it has not been read to the end in time.
+    /// Dropping the reader early cancels it as well.
+    pub timeout: Option<Duration>,
+    /// Directory in which finished results are cached as Arrow IPC files.
+    /// Later identical reads of an unchanged file are served from there.
+    pub cache_dir: Option<String>,
+}
 
-        let schema = stream_reader.schema();
+/// Runs `query` against the .hyper file at `path`. Batches are decoded as the
+/// returned reader is iterated, so the result never has to fit in memory at once.
+pub fn read_from_hyper(
+    path: &str,
+    query: &str,
+    options: &ReadOptions,
+) -> Result<ArrowArrayStreamReader, Box<dyn Error>> {
+    let path = CString::new(path)?;
+    let query = CString::new(query)?;
+    let not_null_columns = options
+        .not_null_columns
+        .iter()
+        .map(|column| CString::new(column.as_str()))
+        .collect::<Result<Vec<_>, _>>()?;
+    let not_null_column_ptrs: Vec<*const c_char> =
+        not_null_columns.iter().map(|column| column.as_ptr()).collect();
+    let cache_dir = options.cache_dir.as_deref().map(CString::new).transpose()?;
 
-        let mut batches: Vec<RecordBatch> = Vec::new();
-        while let Some(batch) = stream_reader.next() {
-            let record_batch = batch.expect("Failed to read record batch");
-            batches.push(record_batch);
+    unsafe {
+        let mut c_options = MaybeUninit::<ToiyaReadOptions>::uninit();
+        toiya_read_options_init(c_options.as_mut_ptr());
+        let mut c_options = c_options.assume_init();
+        c_options.chunk_size = options.chunk_size;
+        c_options.target_batch_bytes = options.target_batch_bytes;
+        c_options.not_null_columns = not_null_column_ptrs.as_ptr();
+        c_options.not_null_column_count = not_null_column_ptrs.len();
+        if let Some(timeout) = options.timeout {
+            c_options.timeout_ms = u64::try_from(timeout.as_millis()).unwrap_or(u64::MAX).max(1);
+        }
+        if let Some(cache_dir) = &cache_dir {
+            c_options.cache_dir = cache_dir.as_ptr();
         }
 
-        let combined_batch = concat_batches(&schema, &batches).expect("Failed to concat batches");
-        println!("Columns: {}, Rows: {}", combined_batch.num_columns(), combined_batch.num_rows());
-        println!("{:?}", combined_batch);
+        let mut error = ToiyaError { code: TOIYA_OK, message: [0; 1024] };
+        let mut stream: *mut ToiyaStream = ptr::null_mut();
+        if toiya_stream_open(path.as_ptr(), query.as_ptr(), &c_options, &mut stream, &mut error) != TOIYA_OK {
+            return Err(Box::new(HyperError::from(error)));
+        }
 
-        (result.release)(result.data);
+        let mut ffi_stream = FFI_ArrowArrayStream::empty();
+        let status = toiya_stream_export(stream, &mut ffi_stream, &mut error);
+        toiya_stream_free(stream);
+        if status != TOIYA_OK {
+            return Err(Box::new(HyperError::from(error)));
+        }
 
-        Ok(combined_batch)
+        Ok(ArrowArrayStreamReader::try_new(ffi_stream)?)
     }
-}
\ No newline at end of file
+}
@@ -0,0 +1,36 @@
+#include "arrow_query.hpp"
+#include "arrow_to_hyper.hpp"
+#include "hyper_session.hpp"
+
+#include <memory>
+#include <stdexcept>
+
+#include <hyperapi/hyperapi.hpp>
+#include <nanoarrow/nanoarrow.hpp>
+
+auto query_arrow_with_hyper(const std::string& path,
+                            const std::vector<ArrowTableInput>& tables,
+                            const std::string& query,
+                            const ReadOptions& options)-> Result {
+    const auto endpoint = GetHyperSession(options.hyper_path).Process().getEndpoint();
+
+    // Not taken from the pool: temporary tables must not leak into later users.
+    auto connection = path.empty()
+        ? std::make_unique<hyperapi::Connection>(endpoint)
+        : std::make_unique<hyperapi::Connection>(endpoint, path);
+
+    for (const auto& table : tables) {
+        nanoarrow::UniqueSchema schema;
+        if (table.stream -> get_schema(table.stream, schema.get()) != 0) {
+            const char* message = table.stream -> get_last_error(table.stream);
+            throw std::runtime_error(message != nullptr ? message : "Failed to read the Arrow stream.");
+        }
+
+        const auto definition = MakeTableDefinitionFromArrow(
+            schema.get(), hyperapi::TableName(table.name), hyperapi::Persistence::Temporary);
+        connection -> getCatalog().createTable(definition);
+        InsertArrowStream(*connection, definition, table.stream);
+    }
+
+    return read_from_hyper_connection(PooledConnection(std::move(connection)), query, options);
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "reader_sample.hpp"
+
+struct ArrowTableInput {
+    // Name under which the query refers to the data.
+    std::string name;
+    // Read to the end but not released.
+    struct ArrowArrayStream* stream;
+};
+
+// Loads every input into a temporary table and runs query over them, with the
+// .hyper file at path attached as the default database so that the query can join
+// both. An empty path runs the query over the inputs alone. The temporary tables
+// live on a dedicated connection that is closed, and the tables dropped with it,
+// when the returned stream is released.
+auto query_arrow_with_hyper(const std::string& path,
+                            const std::vector<ArrowTableInput>& tables,
+                            const std::string& query,
+                            const ReadOptions& options)-> Result;
@@ -0,0 +1,554 @@
+#include "arrow_to_hyper.hpp"
+
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+
+namespace {
+    struct ToiyaArrowToHyperError {
+        static constexpr auto UNSUPPORTED_TYPE = "Cannot insert Arrow values into a column of type ";
+        static constexpr auto UNKNOWN_COLUMN = "Arrow column does not exist in the table: ";
+        static constexpr auto ARROW_FAILED = "Failed to read Arrow data: ";
+        static constexpr auto UNSUPPORTED_ARROW_TYPE = "No Hyper type for Arrow format ";
+        static constexpr auto OUT_OF_RANGE = "Arrow value does not fit the column: ";
+    };
+
+    [[noreturn]] inline void throw_toiya_arrow_to_hyper_error(const char* format, const std::string& detail) {
+        throw std::invalid_argument(std::string(format) + detail);
+    }
+
+    auto IsUnsigned(enum ArrowType type) -> bool {
+        return type == NANOARROW_TYPE_UINT8 || type == NANOARROW_TYPE_UINT16 ||
+               type == NANOARROW_TYPE_UINT32 || type == NANOARROW_TYPE_UINT64;
+    }
+
+    auto IsInteger(enum ArrowType type) -> bool {
+        return IsUnsigned(type) || type == NANOARROW_TYPE_INT8 || type == NANOARROW_TYPE_INT16 ||
+               type == NANOARROW_TYPE_INT32 || type == NANOARROW_TYPE_INT64;
+    }
+
+    // Whether the converter for a column of type tag can read Arrow values of type.
+    // The converters read the Arrow buffers without checks, so this has to hold
+    // before any row is loaded.
+    auto CanLoad(enum ArrowType type, hyperapi::TypeTag tag) -> bool {
+        switch (tag) {
+            case hyperapi::TypeTag::SmallInt: case hyperapi::TypeTag::Int: case hyperapi::TypeTag::BigInt:
+            case hyperapi::TypeTag::Oid:
+                return IsInteger(type);
+            case hyperapi::TypeTag::Float: case hyperapi::TypeTag::Double:
+                return IsInteger(type) || type == NANOARROW_TYPE_FLOAT || type == NANOARROW_TYPE_DOUBLE;
+            case hyperapi::TypeTag::Bool:
+                return type == NANOARROW_TYPE_BOOL;
+            case hyperapi::TypeTag::Text: case hyperapi::TypeTag::Varchar: case hyperapi::TypeTag::Char:
+            case hyperapi::TypeTag::Json:
+                return type == NANOARROW_TYPE_STRING || type == NANOARROW_TYPE_LARGE_STRING;
+            case hyperapi::TypeTag::Bytes: case hyperapi::TypeTag::Geography:
+                return type == NANOARROW_TYPE_BINARY || type == NANOARROW_TYPE_LARGE_BINARY ||
+                       type == NANOARROW_TYPE_FIXED_SIZE_BINARY ||
+                       type == NANOARROW_TYPE_STRING || type == NANOARROW_TYPE_LARGE_STRING;
+            case hyperapi::TypeTag::Date:
+                return type == NANOARROW_TYPE_DATE32 || type == NANOARROW_TYPE_DATE64;
+            case hyperapi::TypeTag::Timestamp: case hyperapi::TypeTag::TimestampTZ:
+                return type == NANOARROW_TYPE_TIMESTAMP;
+            case hyperapi::TypeTag::Time:
+                return type == NANOARROW_TYPE_TIME32 || type == NANOARROW_TYPE_TIME64;
+            case hyperapi::TypeTag::Interval:
+                return type == NANOARROW_TYPE_INTERVAL_MONTHS || type == NANOARROW_TYPE_INTERVAL_DAY_TIME ||
+                       type == NANOARROW_TYPE_INTERVAL_MONTH_DAY_NANO;
+            case hyperapi::TypeTag::Numeric:
+                return type == NANOARROW_TYPE_DECIMAL128 || type == NANOARROW_TYPE_DECIMAL256;
+            default:
+                return false;
+        }
+    }
+
+    template <typename T, typename V> auto CheckedCast(V value) -> T {
+        if (!std::in_range<T>(value)) {
+            throw_toiya_arrow_to_hyper_error(ToiyaArrowToHyperError::OUT_OF_RANGE, std::to_string(value));
+        }
+        return static_cast<T>(value);
+    }
+
+    // Reads an integer of any Arrow width, throwing when it does not fit T.
+    template <typename T> auto GetInteger(const ArrowArrayView* view, int64_t row, bool is_unsigned) -> T {
+        if (is_unsigned) {
+            return CheckedCast<T>(ArrowArrayViewGetUIntUnsafe(view, row));
+        }
+        return CheckedCast<T>(ArrowArrayViewGetIntUnsafe(view, row));
+    }
+
+    constexpr int64_t UsecPerDay = 24LL * 60 * 60 * 1000 * 1000;
+
+    // Hyper's NUMERIC tops out at 38 digits; Arrow's DECIMAL256 allows up to 76.
+    constexpr int32_t MaxNumericPrecision = 38;
+
+    auto FloorDiv(int64_t value, int64_t divisor) -> int64_t {
+        const auto quotient = value / divisor;
+        return (value % divisor != 0 && (value < 0) != (divisor < 0)) ? quotient - 1 : quotient;
+    }
+
+    auto ToUsec(int64_t value, enum ArrowTimeUnit unit) -> int64_t {
+        switch (unit) {
+            case NANOARROW_TIME_UNIT_SECOND: return value * 1'000'000;
+            case NANOARROW_TIME_UNIT_MILLI: return value * 1'000;
+            case NANOARROW_TIME_UNIT_MICRO: return value;
+            case NANOARROW_TIME_UNIT_NANO: return FloorDiv(value, 1'000);
+        }
+        return value;
+    }
+
+    auto MakeDate(int64_t epoch_days) -> hyperapi::Date {
+        const std::chrono::year_month_day ymd{std::chrono::sys_days{std::chrono::days{epoch_days}}};
+        return {static_cast<int32_t>(static_cast<int>(ymd.year())),
+                static_cast<int16_t>(static_cast<unsigned>(ymd.month())),
+                static_cast<int16_t>(static_cast<unsigned>(ymd.day()))};
+    }
+
+    auto MakeTime(int64_t usec_of_day) -> hyperapi::Time {
+        return {static_cast<int8_t>(usec_of_day / 3'600'000'000LL),
+                static_cast<int8_t>(usec_of_day / 60'000'000LL % 60),
+                static_cast<int8_t>(usec_of_day / 1'000'000LL % 60),
+                static_cast<int32_t>(usec_of_day % 1'000'000LL)};
+    }
+}
+
+class ArrowToHyper {
+public:
+    explicit ArrowToHyper(const ArrowArrayView* view) : view_(view) {}
+    virtual ~ArrowToHyper() = default;
+
+    auto Load(hyperapi::Inserter& inserter, int64_t row) -> void {
+        if (ArrowArrayViewIsNull(view_, row)) {
+            LoadNull(inserter);
+            return;
+        }
+        LoadValue(inserter, row);
+    }
+
+protected:
+    auto GetView() const { return view_; }
+    virtual void LoadValue(hyperapi::Inserter& inserter, int64_t row) = 0;
+    virtual void LoadNull(hyperapi::Inserter& inserter) = 0;
+
+private:
+    const ArrowArrayView* view_;
+};
+
+template <typename T> class TypedArrowToHyper : public ArrowToHyper {
+    using ArrowToHyper::ArrowToHyper;
+protected:
+    void LoadNull(hyperapi::Inserter& inserter) override {
+        inserter.add(std::optional<T>{});
+    }
+};
+
+// Also used for OID columns with T = uint32_t.
+template <typename T> class IntegerArrowToHyper : public TypedArrowToHyper<T> {
+public:
+    IntegerArrowToHyper(const ArrowArrayView* view, enum ArrowType type)
+        : TypedArrowToHyper<T>(view), is_unsigned_(IsUnsigned(type)) {}
+
+private:
+    void LoadValue(hyperapi::Inserter& inserter, int64_t row) override {
+        inserter.add(GetInteger<T>(this -> GetView(), row, is_unsigned_));
+    }
+
+    bool is_unsigned_;
+};
+
+template <typename T> class FloatArrowToHyper : public TypedArrowToHyper<T> {
+    using TypedArrowToHyper<T>::TypedArrowToHyper;
+
+    void LoadValue(hyperapi::Inserter& inserter, int64_t row) override {
+        const auto value = ArrowArrayViewGetDoubleUnsafe(this -> GetView(), row);
+        // Infinities and NaN carry over, finite values must not turn into them.
+        if constexpr (std::is_same_v<T, float>) {
+            if (std::isfinite(value) && std::abs(value) > std::numeric_limits<float>::max()) {
+                throw_toiya_arrow_to_hyper_error(ToiyaArrowToHyperError::OUT_OF_RANGE, std::to_string(value));
+            }
+        }
+        inserter.add(static_cast<T>(value));
+    }
+};
+
+class BooleanArrowToHyper : public TypedArrowToHyper<bool> {
+    using TypedArrowToHyper::TypedArrowToHyper;
+
+    void LoadValue(hyperapi::Inserter& inserter, int64_t row) override {
+        inserter.add(ArrowArrayViewGetIntUnsafe(GetView(), row) != 0);
+    }
+};
+
+class StringArrowToHyper : public TypedArrowToHyper<std::string_view> {
+    using TypedArrowToHyper::TypedArrowToHyper;
+
+    void LoadValue(hyperapi::Inserter& inserter, int64_t row) override {
+        const auto value = ArrowArrayViewGetStringUnsafe(GetView(), row);
+        inserter.add(std::string_view{value.data, static_cast<size_t>(value.size_bytes)});
+    }
+};
+
+class BytesArrowToHyper : public TypedArrowToHyper<hyperapi::ByteSpan> {
+    using TypedArrowToHyper::TypedArrowToHyper;
+
+    void LoadValue(hyperapi::Inserter& inserter, int64_t row) override {
+        const auto value = ArrowArrayViewGetBytesUnsafe(GetView(), row);
+        inserter.add(hyperapi::ByteSpan{value.data.as_uint8, static_cast<size_t>(value.size_bytes)});
+    }
+};
+
+class DateArrowToHyper : public TypedArrowToHyper<hyperapi::Date> {
+public:
+    DateArrowToHyper(const ArrowArrayView* view, enum ArrowType type) : TypedArrowToHyper(view), type_(type) {}
+
+private:
+    void LoadValue(hyperapi::Inserter& inserter, int64_t row) override {
+        constexpr int64_t MsPerDay = 24LL * 60 * 60 * 1000;
+        const auto value = ArrowArrayViewGetIntUnsafe(GetView(), row);
+        // date64 counts milliseconds, date32 days.
+        inserter.add(MakeDate(type_ == NANOARROW_TYPE_DATE64 ? FloorDiv(value, MsPerDay) : value));
+    }
+
+    enum ArrowType type_;
+};
+
+template <bool TimeZone> class TimestampArrowToHyper
+    : public TypedArrowToHyper<std::conditional_t<TimeZone, hyperapi::OffsetTimestamp, hyperapi::Timestamp>> {
+public:
+    TimestampArrowToHyper(const ArrowArrayView* view, enum ArrowTimeUnit unit)
+        : TypedArrowToHyper<std::conditional_t<TimeZone, hyperapi::OffsetTimestamp, hyperapi::Timestamp>>(view),
+          unit_(unit) {}
+
+private:
+    void LoadValue(hyperapi::Inserter& inserter, int64_t row) override {
+        const auto epoch_usec = ToUsec(ArrowArrayViewGetIntUnsafe(this -> GetView(), row), unit_);
+        const auto epoch_days = FloorDiv(epoch_usec, UsecPerDay);
+        const auto date = MakeDate(epoch_days);
+        const auto time = MakeTime(epoch_usec - epoch_days * UsecPerDay);
+
+        // Arrow stores zoned timestamps normalized to UTC.
+        if constexpr (TimeZone) {
+            inserter.add(hyperapi::OffsetTimestamp{date, time, std::chrono::minutes{0}});
+        } else {
+            inserter.add(hyperapi::Timestamp{date, time});
+        }
+    }
+
+    enum ArrowTimeUnit unit_;
+};
+
+class TimeArrowToHyper : public TypedArrowToHyper<hyperapi::Time> {
+public:
+    TimeArrowToHyper(const ArrowArrayView* view, enum ArrowTimeUnit unit) : TypedArrowToHyper(view), unit_(unit) {}
+
+private:
+    void LoadValue(hyperapi::Inserter& inserter, int64_t row) override {
+        inserter.add(MakeTime(ToUsec(ArrowArrayViewGetIntUnsafe(GetView(), row), unit_)));
+    }
+
+    enum ArrowTimeUnit unit_;
+};
+
+class IntervalArrowToHyper : public TypedArrowToHyper<hyperapi::Interval> {
+public:
+    IntervalArrowToHyper(const ArrowArrayView* view, enum ArrowType type) : TypedArrowToHyper(view), type_(type) {}
+
+private:
+    void LoadValue(hyperapi::Inserter& inserter, int64_t row) override {
+        struct ArrowInterval interval = {};
+        ArrowIntervalInit(&interval, type_);
+        ArrowArrayViewGetIntervalUnsafe(GetView(), row, &interval);
+
+        const auto usec = interval.ns / 1'000 + static_cast<int64_t>(interval.ms) * 1'000;
+        inserter.add(hyperapi::Interval{0, interval.months, interval.days,
+                                        static_cast<int32_t>(usec / 3'600'000'000LL),
+                                        static_cast<int32_t>(usec / 60'000'000LL % 60),
+                                        static_cast<int32_t>(usec / 1'000'000LL % 60),
+                                        static_cast<int32_t>(usec % 1'000'000LL)});
+    }
+
+    enum ArrowType type_;
+};
+
+// Decimals go in as text and are cast to the column's NUMERIC type by the inserter's
+// column mapping, which keeps precision and scale out of the C++ types.
+class DecimalArrowToHyper : public TypedArrowToHyper<std::string_view> {
+public:
+    DecimalArrowToHyper(const ArrowArrayView* view, int32_t bitwidth, int32_t precision, int32_t scale)
+        : TypedArrowToHyper(view), bitwidth_(bitwidth), precision_(precision), scale_(scale) {}
+
+private:
+    void LoadValue(hyperapi::Inserter& inserter, int64_t row) override {
+        struct ArrowDecimal decimal = {};
+        ArrowDecimalInit(&decimal, bitwidth_, precision_, scale_);
+        ArrowArrayViewGetDecimalUnsafe(GetView(), row, &decimal);
+
+        nanoarrow::UniqueBuffer digits_buffer;
+        if (ArrowDecimalAppendDigitsToBuffer(&decimal, digits_buffer.get())) {
+            throw_toiya_arrow_to_hyper_error(ToiyaArrowToHyperError::ARROW_FAILED, "decimal digits");
+        }
+
+        std::string digits{reinterpret_cast<const char*>(digits_buffer -> data),
+                           static_cast<size_t>(digits_buffer -> size_bytes)};
+        const bool negative = !digits.empty() && digits.front() == '-';
+        if (negative) {
+            digits.erase(0, 1);
+        }
+        if (scale_ > 0) {
+            const auto scale = static_cast<size_t>(scale_);
+            if (digits.size() <= scale) {
+                digits.insert(0, scale + 1 - digits.size(), '0');
+            }
+            digits.insert(digits.size() - scale, 1, '.');
+        } else if (scale_ < 0) {
+            digits.append(static_cast<size_t>(-scale_), '0');
+        }
+        if (negative) {
+            digits.insert(0, 1, '-');
+        }
+
+        inserter.add(std::string_view{digits});
+    }
+
+    int32_t bitwidth_;
+    int32_t precision_;
+    int32_t scale_;
+};
+
+static auto MakeArrowToHyper(const ArrowSchemaView& schema_view,
+                             const ArrowArrayView* view,
+                             const hyperapi::SqlType& target) -> std::unique_ptr<ArrowToHyper> {
+    switch (target.getTag()) {
+        case hyperapi::TypeTag::SmallInt:
+            return std::unique_ptr<ArrowToHyper>(new IntegerArrowToHyper<int16_t>(view, schema_view.type));
+        case hyperapi::TypeTag::Int:
+            return std::unique_ptr<ArrowToHyper>(new IntegerArrowToHyper<int32_t>(view, schema_view.type));
+        case hyperapi::TypeTag::BigInt:
+            return std::unique_ptr<ArrowToHyper>(new IntegerArrowToHyper<int64_t>(view, schema_view.type));
+        case hyperapi::TypeTag::Oid:
+            return std::unique_ptr<ArrowToHyper>(new IntegerArrowToHyper<uint32_t>(view, schema_view.type));
+        case hyperapi::TypeTag::Float:
+            return std::unique_ptr<ArrowToHyper>(new FloatArrowToHyper<float>(view));
+        case hyperapi::TypeTag::Double:
+            return std::unique_ptr<ArrowToHyper>(new FloatArrowToHyper<double>(view));
+        case hyperapi::TypeTag::Bool:
+            return std::unique_ptr<ArrowToHyper>(new BooleanArrowToHyper(view));
+        case hyperapi::TypeTag::Text: case hyperapi::TypeTag::Varchar: case hyperapi::TypeTag::Char:
+        case hyperapi::TypeTag::Json:
+            return std::unique_ptr<ArrowToHyper>(new StringArrowToHyper(view));
+        case hyperapi::TypeTag::Bytes: case hyperapi::TypeTag::Geography:
+            return std::unique_ptr<ArrowToHyper>(new BytesArrowToHyper(view));
+        case hyperapi::TypeTag::Date:
+            return std::unique_ptr<ArrowToHyper>(new DateArrowToHyper(view, schema_view.type));
+        case hyperapi::TypeTag::Timestamp:
+            return std::unique_ptr<ArrowToHyper>(new TimestampArrowToHyper<false>(view, schema_view.time_unit));
+        case hyperapi::TypeTag::TimestampTZ:
+            return std::unique_ptr<ArrowToHyper>(new TimestampArrowToHyper<true>(view, schema_view.time_unit));
+        case hyperapi::TypeTag::Time:
+            return std::unique_ptr<ArrowToHyper>(new TimeArrowToHyper(view, schema_view.time_unit));
+        case hyperapi::TypeTag::Interval:
+            return std::unique_ptr<ArrowToHyper>(new IntervalArrowToHyper(view, schema_view.type));
+        case hyperapi::TypeTag::Numeric:
+            return std::unique_ptr<ArrowToHyper>(new DecimalArrowToHyper(
+                view, schema_view.decimal_bitwidth, schema_view.decimal_precision, schema_view.decimal_scale));
+        default:
+            throw_toiya_arrow_to_hyper_error(ToiyaArrowToHyperError::UNSUPPORTED_TYPE, target.toString());
+    }
+}
+
+ArrowBatchInserter::ArrowBatchInserter(hyperapi::Connection& connection,
+                                       hyperapi::TableDefinition table,
+                                       const struct ArrowSchema* schema)
+    : connection_(connection), table_(std::move(table)) {
+    struct ArrowError error {};
+    if (ArrowSchemaDeepCopy(schema, schema_.get())) {
+        throw_toiya_arrow_to_hyper_error(ToiyaArrowToHyperError::ARROW_FAILED, "ArrowSchemaDeepCopy failed");
+    }
+    if (ArrowArrayViewInitFromSchema(view_.get(), schema_.get(), &error)) {
+        throw_toiya_arrow_to_hyper_error(ToiyaArrowToHyperError::ARROW_FAILED, error.message);
+    }
+
+    const std::span children{schema_ -> children, static_cast<size_t>(schema_ -> n_children)};
+    const std::span child_views{view_ -> children, static_cast<size_t>(view_ -> n_children)};
+
+    for (size_t i = 0; i < children.size(); i++) {
+        const std::string name = children[i] -> name != nullptr ? children[i] -> name : "";
+        const auto position = table_.getColumnPositionByName(hyperapi::Name(name));
+        if (!position) {
+            throw_toiya_arrow_to_hyper_error(ToiyaArrowToHyperError::UNKNOWN_COLUMN, name);
+        }
+        const auto& column = table_.getColumn(*position);
+
+        struct ArrowSchemaView schema_view {};
+        if (ArrowSchemaViewInit(&schema_view, children[i], &error)) {
+            throw_toiya_arrow_to_hyper_error(ToiyaArrowToHyperError::ARROW_FAILED, error.message);
+        }
+        if (!CanLoad(schema_view.type, column.getType().getTag())) {
+            throw_toiya_arrow_to_hyper_error(ToiyaArrowToHyperError::UNSUPPORTED_TYPE,
+                                             column.getType().toString() + " from Arrow format " +
+                                             children[i] -> format + " (column " + name + ")");
+        }
+        converters_.push_back(MakeArrowToHyper(schema_view, child_views[i], column.getType()));
+
+        if (column.getType().getTag() == hyperapi::TypeTag::Numeric) {
+            inserter_columns_.emplace_back(column.getName(), hyperapi::SqlType::text());
+            mappings_.emplace_back(column.getName(),
+                                   "CAST(" + column.getName().toString() + " AS " + column.getType().toString() + ")");
+        } else {
+            inserter_columns_.emplace_back(column.getName(), column.getType());
+            mappings_.emplace_back(column.getName());
+        }
+    }
+}
+
+ArrowBatchInserter::~ArrowBatchInserter() = default;
+
+auto ArrowBatchInserter::Insert(const struct ArrowArray* array) -> int64_t {
+    struct ArrowError error {};
+    if (ArrowArrayViewSetArray(view_.get(), array, &error)) {
+        throw_toiya_arrow_to_hyper_error(ToiyaArrowToHyperError::ARROW_FAILED, error.message);
+    }
+
+    if (!inserter_) {
+        inserter_ = std::make_unique<hyperapi::Inserter>(connection_, table_, mappings_, inserter_columns_);
+    }
+
+    // Child views do not include the offset of the struct, so rows are shifted here.
+    const auto offset = view_ -> offset;
+    const auto length = view_ -> length;
+    for (int64_t row = 0; row < length; row++) {
+        for (const auto& converter : converters_) {
+            converter -> Load(*inserter_, offset + row);
+        }
+        inserter_ -> endRow();
+    }
+
+    return length;
+}
+
+auto ArrowBatchInserter::Commit() -> void {
+    if (inserter_) {
+        inserter_ -> execute();
+        inserter_.reset();
+    }
+}
+
+static auto GetHyperTypeFromArrow(const ArrowSchemaView& schema_view, const char* format) -> hyperapi::SqlType {
+    switch (schema_view.type) {
+        case NANOARROW_TYPE_INT8: case NANOARROW_TYPE_UINT8: case NANOARROW_TYPE_INT16:
+            return hyperapi::SqlType::smallInt();
+        case NANOARROW_TYPE_UINT16: case NANOARROW_TYPE_INT32:
+            return hyperapi::SqlType::integer();
+        case NANOARROW_TYPE_UINT32: case NANOARROW_TYPE_INT64:
+            return hyperapi::SqlType::bigInt();
+        case NANOARROW_TYPE_FLOAT:
+            return hyperapi::SqlType::real();
+        case NANOARROW_TYPE_DOUBLE:
+            return hyperapi::SqlType::doublePrecision();
+        case NANOARROW_TYPE_BOOL:
+            return hyperapi::SqlType::boolean();
+        case NANOARROW_TYPE_STRING: case NANOARROW_TYPE_LARGE_STRING:
+            return hyperapi::SqlType::text();
+        case NANOARROW_TYPE_BINARY: case NANOARROW_TYPE_LARGE_BINARY: case NANOARROW_TYPE_FIXED_SIZE_BINARY:
+            return hyperapi::SqlType::bytes();
+        case NANOARROW_TYPE_DATE32: case NANOARROW_TYPE_DATE64:
+            return hyperapi::SqlType::date();
+        case NANOARROW_TYPE_TIMESTAMP:
+            return schema_view.timezone != nullptr && schema_view.timezone[0] != '\0'
+                ? hyperapi::SqlType::timestampTZ() : hyperapi::SqlType::timestamp();
+        case NANOARROW_TYPE_TIME32: case NANOARROW_TYPE_TIME64:
+            return hyperapi::SqlType::time();
+        case NANOARROW_TYPE_INTERVAL_MONTHS: case NANOARROW_TYPE_INTERVAL_DAY_TIME:
+        case NANOARROW_TYPE_INTERVAL_MONTH_DAY_NANO:
+            return hyperapi::SqlType::interval();
+        case NANOARROW_TYPE_DECIMAL128: case NANOARROW_TYPE_DECIMAL256:
+            if (schema_view.decimal_precision > MaxNumericPrecision || schema_view.decimal_scale < 0) {
+                throw_toiya_arrow_to_hyper_error(ToiyaArrowToHyperError::UNSUPPORTED_ARROW_TYPE,
+                                                 std::string(format) + " (Hyper NUMERIC allows precision up to " +
+                                                     std::to_string(MaxNumericPrecision) +
+                                                     " and no negative scale)");
+            }
+            return hyperapi::SqlType::numeric(static_cast<uint16_t>(schema_view.decimal_precision),
+                                              static_cast<uint16_t>(schema_view.decimal_scale));
+        default:
+            throw_toiya_arrow_to_hyper_error(ToiyaArrowToHyperError::UNSUPPORTED_ARROW_TYPE, format);
+    }
+}
+
+auto MakeTableDefinitionFromArrow(const struct ArrowSchema* schema,
+                                  hyperapi::TableName name,
+                                  hyperapi::Persistence persistence) -> hyperapi::TableDefinition {
+    hyperapi::TableDefinition table(std::move(name), {}, persistence);
+    struct ArrowError error {};
+
+    const std::span children{schema -> children, static_cast<size_t>(schema -> n_children)};
+    for (const auto child : children) {
+        struct ArrowSchemaView schema_view {};
+        if (ArrowSchemaViewInit(&schema_view, child, &error)) {
+            throw_toiya_arrow_to_hyper_error(ToiyaArrowToHyperError::ARROW_FAILED, error.message);
+        }
+        const auto nullability = (child -> flags & ARROW_FLAG_NULLABLE)
+            ? hyperapi::Nullability::Nullable : hyperapi::Nullability::NotNullable;
+        table.addColumn({hyperapi::Name(child -> name != nullptr ? child -> name : ""),
+                         GetHyperTypeFromArrow(schema_view, child -> format), nullability});
+    }
+
+    return table;
+}
+
+auto InsertArrowStream(hyperapi::Connection& connection,
+                       const hyperapi::TableDefinition& table,
+                       struct ArrowArrayStream* stream,
+                       int64_t commit_rows,
+                       const std::function<void()>& on_commit) -> int64_t {
+    const auto stream_error = [stream] {
+        const char* message = stream -> get_last_error(stream);
+        return std::runtime_error(message != nullptr ? message : "Failed to read the Arrow stream.");
+    };
+
+    nanoarrow::UniqueSchema schema;
+    if (stream -> get_schema(stream, schema.get()) != 0) {
+        throw stream_error();
+    }
+
+    ArrowBatchInserter inserter(connection, table, schema.get());
+    int64_t row_count = 0;
+    int64_t pending_rows = 0;
+
+    const auto commit = [&] {
+        inserter.Commit();
+        if (on_commit) {
+            on_commit();
+        }
+        row_count += pending_rows;
+        pending_rows = 0;
+    };
+
+    while (true) {
+        nanoarrow::UniqueArray array;
+        if (stream -> get_next(stream, array.get()) != 0) {
+            throw stream_error();
+        }
+        if (array -> release == nullptr) {
+            break;
+        }
+
+        pending_rows += inserter.Insert(array.get());
+        if (commit_rows > 0 && pending_rows >= commit_rows) {
+            commit();
+        }
+    }
+
+    if (pending_rows > 0) {
+        commit();
+    }
+
+    return row_count;
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include <hyperapi/hyperapi.hpp>
+#include <nanoarrow/nanoarrow.hpp>
+
+class ArrowToHyper;
+
+// Inserts Arrow batches into a Hyper table. Arrow columns are matched to the table
+// columns by name and every value is converted to the type of its target column;
+// table columns that the schema lacks are left NULL. The constructor throws
+// std::invalid_argument for an Arrow type that cannot be converted to its column,
+// and Insert for a value that does not fit it, e.g. 70000 for a SMALLINT.
+class ArrowBatchInserter {
+public:
+    ArrowBatchInserter(hyperapi::Connection& connection,
+                       hyperapi::TableDefinition table,
+                       const struct ArrowSchema* schema);
+    ArrowBatchInserter(const ArrowBatchInserter&) = delete;
+    ArrowBatchInserter &operator=(const ArrowBatchInserter&) = delete;
+    ~ArrowBatchInserter();
+
+    // Returns the number of rows added. They become visible with the next Commit.
+    auto Insert(const struct ArrowArray* array) -> int64_t;
+    auto Commit() -> void;
+
+private:
+    hyperapi::Connection& connection_;
+    hyperapi::TableDefinition table_;
+    std::vector<hyperapi::Inserter::ColumnMapping> mappings_;
+    std::vector<hyperapi::TableDefinition::Column> inserter_columns_;
+    nanoarrow::UniqueSchema schema_;
+    nanoarrow::UniqueArrayView view_;
+    std::vector<std::unique_ptr<ArrowToHyper>> converters_;
+    std::unique_ptr<hyperapi::Inserter> inserter_;
+};
+
+// Table definition with a column of the matching Hyper type for every field of schema.
+// Fields without ARROW_FLAG_NULLABLE become NOT NULL columns.
+auto MakeTableDefinitionFromArrow(const struct ArrowSchema* schema,
+                                  hyperapi::TableName name,
+                                  hyperapi::Persistence persistence) -> hyperapi::TableDefinition;
+
+// Inserts every batch of stream into table and returns the number of rows. When
+// commit_rows is non-zero, rows are committed every commit_rows rows, each time
+// followed by on_commit. The stream is read to the end but not released.
+auto InsertArrowStream(hyperapi::Connection& connection,
+                       const hyperapi::TableDefinition& table,
+                       struct ArrowArrayStream* stream,
+                       int64_t commit_rows = 0,
+                       const std::function<void()>& on_commit = {}) -> int64_t;
@@ -0,0 +1,176 @@
+#include "buffer_pool.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <new>
+#include <span>
+
+namespace {
+    constexpr size_t kMinClassShift = 6; // 64 bytes
+
+    auto SizeClass(int64_t size) -> size_t {
+        const auto bytes = static_cast<size_t>(std::max<int64_t>(size, 1));
+        const auto width = static_cast<size_t>(std::bit_width(bytes - 1));
+        return width <= kMinClassShift ? 0 : width - kMinClassShift;
+    }
+
+    auto ClassBytes(size_t size_class) -> size_t {
+        return size_t{1} << (size_class + kMinClassShift);
+    }
+
+    // Sizes above the largest class are not pooled and only rounded to the alignment.
+    auto BlockBytes(int64_t size) -> size_t {
+        const auto size_class = SizeClass(size);
+        if (size_class < BufferPool::kClassCount) {
+            return ClassBytes(size_class);
+        }
+        const auto bytes = static_cast<size_t>(size);
+        return (bytes + BufferPool::kAlignment - 1) / BufferPool::kAlignment * BufferPool::kAlignment;
+    }
+
+    auto AlignedNew(size_t bytes) noexcept -> uint8_t* {
+        return static_cast<uint8_t*>(
+            ::operator new(bytes, std::align_val_t{BufferPool::kAlignment}, std::nothrow));
+    }
+
+    auto AlignedDelete(uint8_t* ptr) noexcept -> void {
+        ::operator delete(ptr, std::align_val_t{BufferPool::kAlignment});
+    }
+
+    auto HostReallocate(struct ArrowBufferAllocator* allocator, uint8_t* ptr,
+                        int64_t old_size, int64_t new_size) -> uint8_t* {
+        const auto host = static_cast<const toiya_buffer_allocator*>(allocator -> private_data);
+        return host -> reallocate(host -> private_data, ptr, old_size, new_size);
+    }
+
+    auto HostFree(struct ArrowBufferAllocator* allocator, uint8_t* ptr, int64_t size) -> void {
+        const auto host = static_cast<const toiya_buffer_allocator*>(allocator -> private_data);
+        host -> free(host -> private_data, ptr, size);
+    }
+}
+
+auto BufferPool::Create(size_t max_cached_bytes) -> std::unique_ptr<BufferPool, Unref> {
+    return std::unique_ptr<BufferPool, Unref>(new BufferPool(max_cached_bytes));
+}
+
+BufferPool::~BufferPool() {
+    for (auto& free_list : free_lists_) {
+        for (auto block : free_list) {
+            AlignedDelete(block);
+        }
+    }
+}
+
+auto BufferPool::Allocator() -> struct ArrowBufferAllocator {
+    return {&BufferPool::PoolReallocate, &BufferPool::PoolFree, this};
+}
+
+auto BufferPool::Allocate(int64_t size) noexcept -> uint8_t* {
+    const auto size_class = SizeClass(size);
+    uint8_t* block = nullptr;
+
+    if (size_class < kClassCount) {
+        const std::lock_guard lock(mutex_);
+        auto& free_list = free_lists_[size_class];
+        if (!free_list.empty()) {
+            block = free_list.back();
+            free_list.pop_back();
+            cached_bytes_ -= ClassBytes(size_class);
+        }
+    }
+
+    if (block == nullptr) {
+        block = AlignedNew(BlockBytes(size));
+        if (block == nullptr) {
+            return nullptr;
+        }
+    }
+
+    refs_.fetch_add(1, std::memory_order_relaxed);
+    return block;
+}
+
+auto BufferPool::Reallocate(uint8_t* ptr, int64_t old_size, int64_t new_size) noexcept -> uint8_t* {
+    if (ptr == nullptr) {
+        return Allocate(new_size);
+    }
+
+    // The block already has room for the new size.
+    if (BlockBytes(old_size) == BlockBytes(new_size)) {
+        return ptr;
+    }
+
+    auto block = Allocate(new_size);
+    if (block == nullptr) {
+        return nullptr;
+    }
+    std::memcpy(block, ptr, static_cast<size_t>(std::min(old_size, new_size)));
+    Free(ptr, old_size);
+
+    return block;
+}
+
+auto BufferPool::Free(uint8_t* ptr, int64_t size) noexcept -> void {
+    if (ptr == nullptr) {
+        return;
+    }
+
+    const auto size_class = SizeClass(size);
+    bool cached = false;
+
+    if (size_class < kClassCount) {
+        const std::lock_guard lock(mutex_);
+        const auto bytes = ClassBytes(size_class);
+        if (cached_bytes_ + bytes <= max_cached_bytes_) {
+            try {
+                free_lists_[size_class].push_back(ptr);
+                cached_bytes_ += bytes;
+                cached = true;
+            } catch (const std::bad_alloc&) {
+                // Fall through and give the block back to the system.
+            }
+        }
+    }
+
+    if (!cached) {
+        AlignedDelete(ptr);
+    }
+    Release();
+}
+
+auto BufferPool::Release() noexcept -> void {
+    if (refs_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        delete this;
+    }
+}
+
+auto BufferPool::PoolReallocate(struct ArrowBufferAllocator* allocator, uint8_t* ptr,
+                                int64_t old_size, int64_t new_size) -> uint8_t* {
+    return static_cast<BufferPool*>(allocator -> private_data) -> Reallocate(ptr, old_size, new_size);
+}
+
+auto BufferPool::PoolFree(struct ArrowBufferAllocator* allocator, uint8_t* ptr, int64_t size) -> void {
+    static_cast<BufferPool*>(allocator -> private_data) -> Free(ptr, size);
+}
+
+auto MakeHostAllocator(const toiya_buffer_allocator* allocator) -> struct ArrowBufferAllocator {
+    return {&HostReallocate, &HostFree, const_cast<toiya_buffer_allocator*>(allocator)};
+}
+
+auto SetArrayAllocator(struct ArrowArray* array, struct ArrowBufferAllocator allocator) -> ArrowErrorCode {
+    for (int64_t i = 0; i < array -> n_buffers; i++) {
+        if (const auto errcode = ArrowBufferSetAllocator(ArrowArrayBuffer(array, i), allocator)) {
+            return errcode;
+        }
+    }
+
+    const std::span children{array -> children, static_cast<size_t>(array -> n_children)};
+    for (auto child : children) {
+        if (const auto errcode = SetArrayAllocator(child, allocator)) {
+            return errcode;
+        }
+    }
+
+    return NANOARROW_OK;
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <nanoarrow/nanoarrow.h>
+
+#include "toiya.h"
+
+// Recycles Arrow buffers across batches. Blocks are 64-byte aligned and grouped in
+// power-of-two size classes; released blocks are kept for reuse up to max_cached_bytes.
+// The pool is reference counted: the owning stream holds one reference and every
+// live allocation holds another, so batches may outlive the stream that built them.
+class BufferPool {
+public:
+    static constexpr size_t kAlignment = 64;
+    static constexpr size_t kClassCount = 21; // 64 B .. 64 MiB
+
+    struct Unref {
+        auto operator()(BufferPool* pool) const noexcept -> void { pool -> Release(); }
+    };
+
+    static auto Create(size_t max_cached_bytes) -> std::unique_ptr<BufferPool, Unref>;
+
+    BufferPool(const BufferPool&) = delete;
+    BufferPool &operator=(const BufferPool&) = delete;
+
+    auto Allocator() -> struct ArrowBufferAllocator;
+
+private:
+    explicit BufferPool(size_t max_cached_bytes) : max_cached_bytes_(max_cached_bytes) {}
+    ~BufferPool();
+
+    auto Allocate(int64_t size) noexcept -> uint8_t*;
+    auto Reallocate(uint8_t* ptr, int64_t old_size, int64_t new_size) noexcept -> uint8_t*;
+    auto Free(uint8_t* ptr, int64_t size) noexcept -> void;
+    auto Release() noexcept -> void;
+
+    static auto PoolReallocate(struct ArrowBufferAllocator* allocator, uint8_t* ptr,
+                               int64_t old_size, int64_t new_size) -> uint8_t*;
+    static auto PoolFree(struct ArrowBufferAllocator* allocator, uint8_t* ptr, int64_t size) -> void;
+
+    std::atomic<size_t> refs_{1};
+    std::mutex mutex_;
+    std::array<std::vector<uint8_t*>, kClassCount> free_lists_{};
+    size_t cached_bytes_ = 0;
+    size_t max_cached_bytes_;
+};
+
+// Wraps an allocator handed in through the C ABI. The toiya_buffer_allocator must stay
+// valid until every batch built with it has been released.
+auto MakeHostAllocator(const toiya_buffer_allocator* allocator) -> struct ArrowBufferAllocator;
+
+// Points every buffer of array and its children at allocator. Must be called before
+// anything is appended.
+auto SetArrayAllocator(struct ArrowArray* array, struct ArrowBufferAllocator allocator) -> ArrowErrorCode;
@@ -0,0 +1,20 @@
+#include "column_statistics.hpp"
+
+auto HyperLogLog::Estimate() const -> int64_t {
+    constexpr auto m = static_cast<double>(kRegisters);
+    const auto alpha = 0.7213 / (1.0 + 1.079 / m);
+
+    double sum = 0;
+    size_t zeros = 0;
+    for (const auto r : registers_) {
+        sum += std::ldexp(1.0, -r);
+        zeros += r == 0;
+    }
+
+    auto estimate = alpha * m * m / sum;
+    // Linear counting is more accurate while many registers are still empty.
+    if (estimate <= 2.5 * m && zeros != 0) {
+        estimate = m * std::log(m / static_cast<double>(zeros));
+    }
+    return static_cast<int64_t>(std::llround(estimate));
+}
@@ -0,0 +1,141 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Distinct count estimate in 2 KiB, with a standard error of about 2.3%.
+class HyperLogLog {
+public:
+    static constexpr int kPrecision = 11;
+    static constexpr size_t kRegisters = size_t{1} << kPrecision;
+
+    auto Add(uint64_t hash) -> void {
+        const auto index = hash >> (64 - kPrecision);
+        const auto rank = static_cast<uint8_t>(std::countl_zero((hash << kPrecision) | (uint64_t{1} << (kPrecision - 1))) + 1);
+        registers_[index] = std::max(registers_[index], rank);
+    }
+
+    auto Clear() -> void { registers_.fill(0); }
+
+    auto Estimate() const -> int64_t;
+
+private:
+    std::array<uint8_t, kRegisters> registers_{};
+};
+
+// Statistics of one column over one batch, collected by the read helpers while they
+// decode. Integers, booleans, dates, timestamps and times are ordered by their Arrow
+// storage value, floats as doubles and strings and binaries bytewise. Intervals and
+// decimals only get a null count and a distinct estimate.
+class ColumnStatistics {
+public:
+    enum class Kind { None, Int, Double, Bytes };
+
+    static auto Mix(uint64_t x) -> uint64_t {
+        // splitmix64 finalizer
+        x ^= x >> 30;
+        x *= 0xbf58476d1ce4e5b9ULL;
+        x ^= x >> 27;
+        x *= 0x94d049bb133111ebULL;
+        return x ^ (x >> 31);
+    }
+
+    static auto Hash(std::string_view bytes) -> uint64_t {
+        uint64_t hash = 0xcbf29ce484222325ULL;
+        for (const auto c : bytes) {
+            hash ^= static_cast<uint8_t>(c);
+            hash *= 0x100000001b3ULL;
+        }
+        return Mix(hash);
+    }
+
+    auto Clear() -> void {
+        kind_ = Kind::None;
+        null_count_ = 0;
+        min_bytes_.clear();
+        max_bytes_.clear();
+        distinct_.Clear();
+    }
+
+    auto AddNull() -> void { null_count_++; }
+
+    auto AddInt(int64_t value) -> void {
+        distinct_.Add(Mix(static_cast<uint64_t>(value)));
+        if (kind_ == Kind::None) {
+            kind_ = Kind::Int;
+            min_int_ = max_int_ = value;
+            return;
+        }
+        min_int_ = std::min(min_int_, value);
+        max_int_ = std::max(max_int_, value);
+    }
+
+    auto AddDouble(double value) -> void {
+        if (std::isnan(value)) {
+            distinct_.Add(Mix(std::numeric_limits<uint64_t>::max()));
+            return;
+        }
+        // -0.0 and 0.0 are the same value.
+        distinct_.Add(Mix(std::bit_cast<uint64_t>(value == 0 ? 0.0 : value)));
+        if (kind_ == Kind::None) {
+            kind_ = Kind::Double;
+            min_double_ = max_double_ = value;
+            return;
+        }
+        min_double_ = std::min(min_double_, value);
+        max_double_ = std::max(max_double_, value);
+    }
+
+    auto AddBytes(std::string_view value) -> void {
+        distinct_.Add(Hash(value));
+        if (kind_ == Kind::None) {
+            kind_ = Kind::Bytes;
+            min_bytes_ = max_bytes_ = value;
+            return;
+        }
+        // Copies only when a bound moves, which becomes rare after the first rows.
+        if (value < min_bytes_) {
+            min_bytes_ = value;
+        } else if (value > max_bytes_) {
+            max_bytes_ = value;
+        }
+    }
+
+    // For values without an order here.
+    auto AddUnordered(uint64_t hash) -> void { distinct_.Add(hash); }
+
+    auto GetKind() const { return kind_; }
+    auto GetNullCount() const { return null_count_; }
+    auto GetDistinctEstimate() const { return distinct_.Estimate(); }
+    auto GetMinInt() const { return min_int_; }
+    auto GetMaxInt() const { return max_int_; }
+    auto GetMinDouble() const { return min_double_; }
+    auto GetMaxDouble() const { return max_double_; }
+    auto GetMinBytes() const -> const std::string& { return min_bytes_; }
+    auto GetMaxBytes() const -> const std::string& { return max_bytes_; }
+
+private:
+    Kind kind_ = Kind::None;
+    int64_t null_count_ = 0;
+    int64_t min_int_ = 0;
+    int64_t max_int_ = 0;
+    double min_double_ = 0;
+    double max_double_ = 0;
+    std::string min_bytes_;
+    std::string max_bytes_;
+    HyperLogLog distinct_;
+};
+
+// Statistics of the batch a stream emitted last, shared between the stream and its
+// consumer in the same way as the QueryCanceller.
+struct BatchStatistics {
+    std::vector<ColumnStatistics> columns;
+};
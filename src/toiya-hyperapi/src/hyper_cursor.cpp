@@ -0,0 +1,244 @@
+#include "hyper_cursor.hpp"
+#include "query_canceller.hpp"
+
+#include <algorithm>
+#include <condition_variable>
+#include <new>
+#include <queue>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <nanoarrow/nanoarrow.hpp>
+
+namespace {
+    const auto kCursorTable = hyperapi::TableName("toiya_cursor").toString();
+    const auto kRowColumn = hyperapi::Name("toiya_row").toString();
+
+    // A single thread that closes cursors once they have been idle for too long.
+    class CursorReaper {
+    public:
+        CursorReaper() : thread_(&CursorReaper::Run, this) {}
+
+        ~CursorReaper() {
+            {
+                const std::lock_guard lock(mutex_);
+                stopping_ = true;
+            }
+            cv_.notify_one();
+            thread_.join();
+        }
+
+        auto Schedule(std::weak_ptr<HyperCursor> cursor, std::chrono::steady_clock::time_point check) -> void {
+            {
+                const std::lock_guard lock(mutex_);
+                checks_.emplace(check, std::move(cursor));
+            }
+            cv_.notify_one();
+        }
+
+    private:
+        using Entry = std::pair<std::chrono::steady_clock::time_point, std::weak_ptr<HyperCursor>>;
+
+        struct Later {
+            auto operator()(const Entry& lhs, const Entry& rhs) const { return lhs.first > rhs.first; }
+        };
+
+        auto Run() -> void {
+            std::unique_lock lock(mutex_);
+            while (!stopping_) {
+                if (checks_.empty()) {
+                    cv_.wait(lock);
+                    continue;
+                }
+
+                const auto check = checks_.top().first;
+                const auto now = std::chrono::steady_clock::now();
+                if (now < check) {
+                    cv_.wait_until(lock, check);
+                    continue;
+                }
+
+                auto cursor = checks_.top().second.lock();
+                checks_.pop();
+                if (cursor) {
+                    lock.unlock();
+                    const auto next_check = cursor -> ExpireIfIdle(now);
+                    lock.lock();
+                    if (next_check) {
+                        checks_.emplace(*next_check, cursor);
+                    }
+                }
+            }
+        }
+
+        std::mutex mutex_;
+        std::condition_variable cv_;
+        std::priority_queue<Entry, std::vector<Entry>, Later> checks_;
+        bool stopping_ = false;
+        // Started last, once everything it touches exists.
+        std::thread thread_;
+    };
+
+    auto GetCursorReaper() -> CursorReaper& {
+        static CursorReaper reaper;
+        return reaper;
+    }
+
+    // Runs a statement on connection under the read timeout of the cursor.
+    auto ExecuteWithTimeout(hyperapi::Connection& connection,
+                            const std::string& statement,
+                            std::chrono::milliseconds timeout) -> void {
+        const auto canceller = std::make_shared<QueryCanceller>(&connection);
+        if (timeout.count() > 0) {
+            CancelAtDeadline(canceller, std::chrono::steady_clock::now() + timeout);
+        }
+
+        try {
+            connection.executeCommand(statement);
+        } catch (const hyperapi::HyperException&) {
+            canceller -> Detach();
+            if (const auto reason = canceller -> GetReason(); reason != QueryCanceller::Reason::None) {
+                throw QueryCancelledError(reason);
+            }
+            throw;
+        }
+        canceller -> Detach();
+        // The deadline may have passed just after the statement finished, leaving a
+        // cancel request in flight that would hit the next statement.
+        if (const auto reason = canceller -> GetReason(); reason != QueryCanceller::Reason::None) {
+            throw QueryCancelledError(reason);
+        }
+    }
+}
+
+HyperCursor::HyperCursor(std::unique_ptr<hyperapi::Connection> connection, const CursorOptions& options)
+    : connection_(std::move(connection)), read_options_(options.read), page_timeout_(options.read.timeout),
+      idle_timeout_(options.idle_timeout), last_used_(std::chrono::steady_clock::now()) {
+    // The reader closes connections whose query hit its timeout, which would drop
+    // the materialized result, so Fetch enforces the page timeout instead.
+    read_options_.timeout = std::chrono::milliseconds{0};
+    read_options_.buffer_pool_bytes = 0;
+}
+
+HyperCursor::~HyperCursor() = default;
+
+auto HyperCursor::Open(const std::string& path,
+                       const std::string& query,
+                       const CursorOptions& options) -> std::shared_ptr<HyperCursor> {
+    const auto endpoint = GetHyperSession(options.read.hyper_path).Process().getEndpoint();
+    // Not taken from the pool: the temporary table must not leak into later users.
+    auto connection = std::make_unique<hyperapi::Connection>(endpoint, path);
+
+    // Sorting by the row number stores the pages contiguously, so that a range only
+    // touches the blocks it needs.
+    ExecuteWithTimeout(*connection,
+                       "CREATE TEMPORARY TABLE " + kCursorTable + " AS SELECT (row_number() OVER (" +
+                       (options.order_by.empty() ? "" : "ORDER BY " + options.order_by) + ") - 1) AS " + kRowColumn +
+                       ", toiya_query.* FROM (" + query + ") AS toiya_query ORDER BY 1",
+                       options.read.timeout);
+
+    const auto row_count = connection -> executeScalarQuery<int64_t>("SELECT COUNT(*) FROM " + kCursorTable);
+
+    std::string column_list;
+    {
+        const auto result = connection -> executeQuery("SELECT * FROM " + kCursorTable + " LIMIT 0");
+        const auto& schema = result.getSchema();
+        for (size_t i = 1; i < schema.getColumnCount(); i++) {
+            column_list += (i > 1 ? ", " : "") + schema.getColumn(i).getName().toString();
+        }
+    }
+
+    auto cursor = std::shared_ptr<HyperCursor>(new HyperCursor(std::move(connection), options));
+    cursor -> row_count_ = row_count;
+    cursor -> column_list_ = std::move(column_list);
+
+    if (options.idle_timeout.count() > 0) {
+        GetCursorReaper().Schedule(cursor, cursor -> last_used_ + options.idle_timeout);
+    }
+    return cursor;
+}
+
+auto HyperCursor::Fetch(int64_t offset, int64_t count) -> Result {
+    if (offset < 0 || count < 0) {
+        throw std::invalid_argument("cursor offset and count must not be negative");
+    }
+
+    const std::lock_guard lock(mutex_);
+    if (!connection_) {
+        throw CursorClosedError();
+    }
+    last_used_ = std::chrono::steady_clock::now();
+
+    const auto end = offset + std::min(count, std::max<int64_t>(row_count_ - offset, 0));
+    const auto query = "SELECT " + column_list_ + " FROM " + kCursorTable +
+                       " WHERE " + kRowColumn + " >= " + std::to_string(offset) +
+                       " AND " + kRowColumn + " < " + std::to_string(end) +
+                       " ORDER BY " + kRowColumn;
+
+    // Cancels the page through a canceller of its own, so that the connection is
+    // handed back and the cursor stays usable after a page timed out.
+    const auto timer = std::make_shared<QueryCanceller>(connection_.get());
+    if (page_timeout_.count() > 0) {
+        CancelAtDeadline(timer, std::chrono::steady_clock::now() + page_timeout_);
+    }
+    const auto throw_if_timed_out = [&timer] {
+        timer -> Detach();
+        if (const auto reason = timer -> GetReason(); reason != QueryCanceller::Reason::None) {
+            throw QueryCancelledError(reason);
+        }
+    };
+
+    // The page is read right away, so the connection is back before the next fetch.
+    nanoarrow::UniqueSchema schema;
+    nanoarrow::UniqueArray array;
+    try {
+        read_single_batch(PooledConnection(this, "", std::move(connection_)), query, read_options_,
+                          schema.get(), array.get());
+    } catch (...) {
+        throw_if_timed_out();
+        throw;
+    }
+    throw_if_timed_out();
+
+    struct ArrowArrayStream out {};
+    const int64_t batch_count = array -> release != nullptr ? 1 : 0;
+    if (ArrowBasicArrayStreamInit(&out, schema.get(), batch_count)) {
+        throw std::bad_alloc();
+    }
+    if (batch_count != 0) {
+        ArrowBasicArrayStreamSetArray(&out, 0, array.get());
+    }
+
+    return make_stream_result(&out);
+}
+
+auto HyperCursor::Close() -> void {
+    const std::lock_guard lock(mutex_);
+    connection_.reset();
+}
+
+auto HyperCursor::ExpireIfIdle(std::chrono::steady_clock::time_point now)
+    -> std::optional<std::chrono::steady_clock::time_point> {
+    const std::unique_lock lock(mutex_, std::try_to_lock);
+    if (!lock.owns_lock()) {
+        // A fetch is running, so the cursor is not idle.
+        return now + idle_timeout_;
+    }
+    if (!connection_) {
+        return std::nullopt;
+    }
+    if (now - last_used_ >= idle_timeout_) {
+        connection_.reset();
+        return std::nullopt;
+    }
+    return last_used_ + idle_timeout_;
+}
+
+auto HyperCursor::Return(const std::string&,
+                         std::unique_ptr<hyperapi::Connection> connection,
+                         std::unique_ptr<PreparedStatements>) noexcept -> void {
+    if (connection -> isOpen()) {
+        connection_ = std::move(connection);
+    }
+}
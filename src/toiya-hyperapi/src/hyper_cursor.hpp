@@ -0,0 +1,77 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+
+#include <hyperapi/hyperapi.hpp>
+
+#include "hyper_session.hpp"
+#include "reader_sample.hpp"
+
+struct CursorOptions {
+    // Numbers the rows in this order, e.g. "price DESC, id". Empty keeps the order
+    // in which the query produces them, which is only fixed once materialized.
+    std::string order_by;
+    // Closes the cursor after this long without a fetch. 0 keeps it open until it
+    // is destroyed.
+    std::chrono::milliseconds idle_timeout{std::chrono::minutes(10)};
+    // Used for the query and every page; batching options are overridden for pages.
+    ReadOptions read{};
+};
+
+class CursorClosedError : public std::runtime_error {
+public:
+    CursorClosedError() : std::runtime_error("cursor has expired or lost its connection") {}
+};
+
+// A query result materialized once into a numbered temporary table, from which any
+// row range is served without running the query again. The table lives on a
+// dedicated connection that the cursor keeps until it is destroyed or expires.
+class HyperCursor : private ConnectionPool, public std::enable_shared_from_this<HyperCursor> {
+public:
+    static auto Open(const std::string& path,
+                     const std::string& query,
+                     const CursorOptions& options) -> std::shared_ptr<HyperCursor>;
+
+    HyperCursor(const HyperCursor&) = delete;
+    HyperCursor &operator=(const HyperCursor&) = delete;
+    ~HyperCursor();
+
+    auto RowCount() const -> int64_t { return row_count_; }
+
+    // Rows [offset, offset + count) as a stream of at most one batch. Fetches of one
+    // cursor run one at a time.
+    auto Fetch(int64_t offset, int64_t count) -> Result;
+
+    // Drops the materialized result. Later fetches throw CursorClosedError.
+    auto Close() -> void;
+
+    // Closes the cursor when it has been idle for its timeout. Otherwise returns
+    // when to check again.
+    auto ExpireIfIdle(std::chrono::steady_clock::time_point now)
+        -> std::optional<std::chrono::steady_clock::time_point>;
+
+private:
+    HyperCursor(std::unique_ptr<hyperapi::Connection> connection, const CursorOptions& options);
+
+    // A page's stream hands the connection back here once it is released, which
+    // happens inside Fetch while mutex_ is held.
+    auto Return(const std::string& database,
+                std::unique_ptr<hyperapi::Connection> connection,
+                std::unique_ptr<PreparedStatements> prepared) noexcept -> void override;
+
+    std::mutex mutex_;
+    std::unique_ptr<hyperapi::Connection> connection_;
+    ReadOptions read_options_;
+    // Applied to every page by the cursor itself, see Fetch.
+    std::chrono::milliseconds page_timeout_;
+    std::chrono::milliseconds idle_timeout_;
+    std::chrono::steady_clock::time_point last_used_;
+    std::string column_list_;
+    int64_t row_count_ = 0;
+};
@@ -0,0 +1,76 @@
+#include "hyper_preview.hpp"
+#include "hyper_session.hpp"
+
+#include <locale>
+#include <sstream>
+#include <stdexcept>
+
+#include <hyperapi/hyperapi.hpp>
+
+namespace {
+    auto ValidatePreviewOptions(const PreviewOptions& options) -> void {
+        if (options.percent < 0 || options.percent > 100) {
+            throw std::invalid_argument("preview percent must be between 0 and 100");
+        }
+        if (options.rows == 0 && options.percent == 0) {
+            throw std::invalid_argument("preview needs a row count or a percentage");
+        }
+    }
+
+    auto LimitClause(const PreviewOptions& options) -> std::string {
+        return options.rows != 0 ? " LIMIT " + std::to_string(options.rows) : "";
+    }
+
+    auto FormatPercent(double percent) -> std::string {
+        std::ostringstream out;
+        out.imbue(std::locale::classic());
+        out.precision(17);
+        out << percent;
+        return out.str();
+    }
+
+    // Drops trailing semicolons and whitespace so that the query can be nested.
+    auto StripQuery(const std::string& query) -> std::string {
+        const auto end = query.find_last_not_of(" \t\r\n;");
+        return end == std::string::npos ? "" : query.substr(0, end + 1);
+    }
+
+    auto ReadPreview(const std::string& path, const std::string& query, const PreviewOptions& options) -> Result {
+        auto read_options = options.read;
+        read_options.single_batch = true;
+        read_options.chunk_size = 0;
+        read_options.target_batch_bytes = 0;
+        // A single batch gains nothing from recycled buffers.
+        read_options.buffer_pool_bytes = 0;
+
+        return read_from_hyper_query(path, query, read_options);
+    }
+}
+
+auto preview_hyper_table(const std::string& path,
+                         const std::string& table,
+                         const PreviewOptions& options)-> Result {
+    ValidatePreviewOptions(options);
+
+    std::string query = "SELECT * FROM " + ParseTableName(table).toString();
+    if (options.percent != 0) {
+        query += " TABLESAMPLE SYSTEM (" + FormatPercent(options.percent) + ")";
+    }
+    query += LimitClause(options);
+
+    return ReadPreview(path, query, options);
+}
+
+auto preview_hyper_query(const std::string& path,
+                         const std::string& query,
+                         const PreviewOptions& options)-> Result {
+    ValidatePreviewOptions(options);
+
+    std::string preview_query = "SELECT * FROM (" + StripQuery(query) + ") AS toiya_preview";
+    if (options.percent != 0) {
+        preview_query += " WHERE random() < " + FormatPercent(options.percent / 100);
+    }
+    preview_query += LimitClause(options);
+
+    return ReadPreview(path, preview_query, options);
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <string>
+
+#include "reader_sample.hpp"
+
+struct PreviewOptions {
+    // At most this many rows. 0 leaves the size to percent alone.
+    size_t rows = 100;
+    // When non-zero, samples about this percentage of the rows instead of taking
+    // the first ones.
+    double percent = 0;
+    // Used for the underlying read; batching options are overridden.
+    ReadOptions read{};
+};
+
+// Small previews returned as a stream holding a single batch. Hyper stops producing
+// rows at the limit, so even huge extracts answer quickly.
+
+// Samples a table with TABLESAMPLE, which skips whole blocks of the table. table is
+// parsed with ParseTableName.
+auto preview_hyper_table(const std::string& path,
+                         const std::string& table,
+                         const PreviewOptions& options)-> Result;
+
+// Previews an arbitrary query. Percent sampling filters the rows of the query, so
+// unlike preview_hyper_table it still reads the query's input.
+auto preview_hyper_query(const std::string& path,
+                         const std::string& query,
+                         const PreviewOptions& options)-> Result;
@@ -0,0 +1,134 @@
+#include "hyper_session.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace {
+    auto MakeHyperProcess(const std::string& hyper_path) -> hyperapi::HyperProcess {
+        std::unordered_map<std::string, std::string> process_params = {};
+
+        if (!process_params.count("log_config")) {
+            process_params["log_config"] = "";
+        } else {
+            process_params.erase("log_config");
+        }
+
+        if (!process_params.count("default_database_version"))
+            process_params["default_database_version"] = "2";
+
+        if (hyper_path.empty()) {
+            return hyperapi::HyperProcess{hyperapi::Telemetry::DoNotSendUsageDataToTableau, "", process_params};
+        }
+        return hyperapi::HyperProcess{hyper_path, hyperapi::Telemetry::DoNotSendUsageDataToTableau, "", process_params};
+    }
+}
+
+auto PooledConnection::operator=(PooledConnection&& other) noexcept -> PooledConnection& {
+    if (this != &other) {
+        Reset();
+        pool_ = other.pool_;
+        database_ = std::move(other.database_);
+        connection_ = std::move(other.connection_);
+        prepared_ = std::move(other.prepared_);
+    }
+    return *this;
+}
+
+PooledConnection::~PooledConnection() {
+    Reset();
+}
+
+auto PooledConnection::Prepared() -> PreparedStatements& {
+    if (!prepared_) {
+        prepared_ = std::make_unique<PreparedStatements>();
+    }
+    return *prepared_;
+}
+
+auto PooledConnection::Reset() noexcept -> void {
+    if (pool_ != nullptr && connection_ != nullptr) {
+        pool_ -> Return(database_, std::move(connection_), std::move(prepared_));
+    }
+    connection_.reset();
+    prepared_.reset();
+}
+
+HyperSession::HyperSession(const std::string& hyper_path) : process_(MakeHyperProcess(hyper_path)) {}
+
+auto HyperSession::Acquire(const std::string& database) -> PooledConnection {
+    {
+        const std::lock_guard lock(mutex_);
+        auto& idle = idle_[database];
+        while (!idle.empty()) {
+            auto connection = std::move(idle.back());
+            idle.pop_back();
+            if (connection.connection -> isOpen()) {
+                return {this, database, std::move(connection.connection), std::move(connection.prepared)};
+            }
+        }
+    }
+
+    return {this, database, std::make_unique<hyperapi::Connection>(process_.getEndpoint(), database)};
+}
+
+auto HyperSession::Return(const std::string& database,
+                          std::unique_ptr<hyperapi::Connection> connection,
+                          std::unique_ptr<PreparedStatements> prepared) noexcept -> void {
+    if (!connection -> isOpen()) {
+        return;
+    }
+
+    try {
+        const std::lock_guard lock(mutex_);
+        auto& idle = idle_[database];
+        if (idle.size() < kMaxIdlePerDatabase) {
+            idle.push_back({std::move(connection), std::move(prepared)});
+        }
+    } catch (...) {
+        // The connection is simply closed when it cannot be kept.
+    }
+}
+
+auto GetHyperSession(const std::string& hyper_path) -> HyperSession& {
+    static HyperSession session{hyper_path};
+
+    return session;
+}
+
+auto ParseTableName(const std::string& name) -> hyperapi::TableName {
+    std::vector<std::string> parts(1);
+    // Whether the current part started with a quote, and whether it is still open.
+    bool part_quoted = false;
+    bool in_quotes = false;
+    for (size_t i = 0; i < name.size(); i++) {
+        const char c = name[i];
+        if (in_quotes) {
+            if (c != '"') {
+                parts.back() += c;
+            } else if (i + 1 < name.size() && name[i + 1] == '"') {
+                parts.back() += c;
+                i++;
+            } else {
+                in_quotes = false;
+            }
+        } else if (c == '.') {
+            parts.emplace_back();
+            part_quoted = false;
+        } else if (c == '"' && parts.back().empty() && !part_quoted) {
+            part_quoted = in_quotes = true;
+        } else if (part_quoted || c == '"') {
+            throw std::invalid_argument("Invalid table name: " + name);
+        } else {
+            parts.back() += c;
+        }
+    }
+
+    if (in_quotes || parts.size() > 2 ||
+        std::any_of(parts.begin(), parts.end(), [](const auto& part) { return part.empty(); })) {
+        throw std::invalid_argument("Invalid table name: " + name);
+    }
+    if (parts.size() == 1) {
+        return hyperapi::TableName(parts[0]);
+    }
+    return hyperapi::TableName(hyperapi::SchemaName(parts[0]), hyperapi::Name(parts[1]));
+}
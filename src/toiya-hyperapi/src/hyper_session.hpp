@@ -0,0 +1,107 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <hyperapi/hyperapi.hpp>
+
+// Statements prepared on one connection, which only exist as long as it does.
+struct PreparedStatements {
+    // Statement name by parameter types and query text.
+    std::unordered_map<std::string, std::string> names;
+    uint64_t next_id = 0;
+};
+
+// Takes back the connections it lent out as PooledConnection.
+class ConnectionPool {
+public:
+    virtual auto Return(const std::string& database,
+                        std::unique_ptr<hyperapi::Connection> connection,
+                        std::unique_ptr<PreparedStatements> prepared) noexcept -> void = 0;
+
+protected:
+    ~ConnectionPool() = default;
+};
+
+// A connection borrowed from a pool, usually the session. It goes back to the pool
+// when destroyed, unless it has been discarded or closed.
+class PooledConnection {
+public:
+    PooledConnection() = default;
+    PooledConnection(ConnectionPool* pool, std::string database, std::unique_ptr<hyperapi::Connection> connection,
+                     std::unique_ptr<PreparedStatements> prepared = nullptr)
+        : pool_(pool), database_(std::move(database)), connection_(std::move(connection)),
+          prepared_(std::move(prepared)) {}
+    // A connection that belongs to no session and is closed when destroyed.
+    explicit PooledConnection(std::unique_ptr<hyperapi::Connection> connection)
+        : connection_(std::move(connection)) {}
+    PooledConnection(const PooledConnection&) = delete;
+    PooledConnection &operator=(const PooledConnection&) = delete;
+    PooledConnection(PooledConnection&&) noexcept = default;
+    PooledConnection &operator=(PooledConnection&& other) noexcept;
+    ~PooledConnection();
+
+    auto operator*() const -> hyperapi::Connection& { return *connection_; }
+    auto operator->() const -> hyperapi::Connection* { return connection_.get(); }
+    explicit operator bool() const { return connection_ != nullptr; }
+
+    // Closes the connection instead of returning it, e.g. after it failed.
+    auto Discard() -> void {
+        connection_.reset();
+        prepared_.reset();
+    }
+
+    // The statements prepared on this connection, kept with it in the pool.
+    auto Prepared() -> PreparedStatements&;
+
+private:
+    auto Reset() noexcept -> void;
+
+    ConnectionPool* pool_ = nullptr;
+    std::string database_;
+    std::unique_ptr<hyperapi::Connection> connection_;
+    std::unique_ptr<PreparedStatements> prepared_;
+};
+
+// The Hyper process shared by every reader, together with idle connections per
+// database so that repeated reads skip connecting.
+class HyperSession : private ConnectionPool {
+public:
+    static constexpr size_t kMaxIdlePerDatabase = 8;
+
+    explicit HyperSession(const std::string& hyper_path);
+    HyperSession(const HyperSession&) = delete;
+    HyperSession &operator=(const HyperSession&) = delete;
+
+    auto Process() const -> const hyperapi::HyperProcess& { return process_; }
+
+    auto Acquire(const std::string& database) -> PooledConnection;
+
+private:
+    struct IdleConnection {
+        std::unique_ptr<hyperapi::Connection> connection;
+        std::unique_ptr<PreparedStatements> prepared;
+    };
+
+    auto Return(const std::string& database,
+                std::unique_ptr<hyperapi::Connection> connection,
+                std::unique_ptr<PreparedStatements> prepared) noexcept -> void override;
+
+    // Declared first so that pooled connections are closed before the process stops.
+    hyperapi::HyperProcess process_;
+    std::mutex mutex_;
+    std::unordered_map<std::string, std::vector<IdleConnection>> idle_;
+};
+
+// Started on first use, so the hyper_path of the first caller wins; an empty path
+// searches next to the Hyper API.
+auto GetHyperSession(const std::string& hyper_path = "") -> HyperSession&;
+
+// Parses a table name as written in SQL, optionally qualified with its schema, e.g.
+// orders, "Order Items" or "Extract"."Extract". Parts in double quotes may contain
+// dots and "" for a quote; unquoted parts are taken as they are, without folding.
+auto ParseTableName(const std::string& name) -> hyperapi::TableName;
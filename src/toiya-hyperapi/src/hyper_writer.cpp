@@ -1,22 +1,36 @@
 #include "hyper_writer.hpp"
+#include "arrow_to_hyper.hpp"
+#include "hyper_session.hpp"
 
+#include <algorithm>
 #include <filesystem>
 #include <iostream>
+#include <limits>
+#include <sstream>
 #include <stdexcept>
 #include <fstream>
+#include <unordered_map>
 #include <vector>
 #include <regex>
 
 hyperapi::SqlType inferType(const std::vector<std::string>& sampleData);
 hyperapi::TableDefinition inferTypesFromCsv(const std::string& csvFilePath, const std::string& tableName, char delimiter);
 bool isBoolean(const std::string& value);
+hyperapi::TableDefinition narrowIntegerColumns(hyperapi::Connection& connection,
+                                               const hyperapi::TableDefinition& tableDefinition,
+                                               const hyperapi::TableName& stageTable);
+
+namespace {
+    const hyperapi::TableName csvStageTable("toiya_csv_stage");
+}
 
 void createHyperFileFromCsv(const std::string& csvFilePath,
                             const std::string& hyperFilePath,
                             const std::optional<hyperapi::TableDefinition>& tableDefinition,
                             const std::string& tableName,
                             char delimiter,
-                            int databaseVersion) {
+                            int databaseVersion,
+                            const CsvLoadOptions& loadOptions) {
     if (databaseVersion > 4) {
         throw std::invalid_argument("databaseVersion supports only 0, 1, 2, 3, 4.");
     }
@@ -46,16 +60,54 @@ void createHyperFileFromCsv(const std::string& csvFilePath,
 
             hyperapi::TableDefinition tableDefinitionData = (tableDefinition.has_value()) ? tableDefinition.value() : inferTypesFromCsv(absolute(pathToFile).string(), tableName, delimiter);
 
+            for (const auto& clusterColumn : loadOptions.clusterColumns) {
+                if (!tableDefinitionData.getColumnPositionByName(clusterColumn)) {
+                    throw std::invalid_argument("Cluster column " + clusterColumn + " is not a column of the table.");
+                }
+            }
+
+            // Clustering and narrowing rewrite the rows, so they are loaded into a
+            // temporary stage first and copied over in one INSERT ... SELECT.
+            const bool staged = !loadOptions.clusterColumns.empty() || loadOptions.narrowTypes;
+            hyperapi::TableDefinition copyTarget = tableDefinitionData;
+            if (staged) {
+                copyTarget.setTableName(csvStageTable).setPersistence(hyperapi::Persistence::Temporary);
+            }
+
             const hyperapi::Catalog& catalog = connection.getCatalog();
-            catalog.createTable(tableDefinitionData);
+            catalog.createTable(copyTarget);
 
             std::cout << "Issuing the SQL COPY command to load the csv file into the table. Since the first line" << std::endl;
             std::cout << "of our csv file contains the column names, we use the `header` option to skip it." << std::endl;
             int64_t rowCount = connection.executeCommand(
-                "COPY " + tableDefinitionData.getTableName().toString() + " FROM " +
+                "COPY " + copyTarget.getTableName().toString() + " FROM " +
                 hyperapi::escapeStringLiteral(absolute(pathToFile).string()) + " WITH (format csv, delimiter '" + delimiter + "', header)"
                 );
 
+            if (staged) {
+                if (loadOptions.narrowTypes) {
+                    tableDefinitionData = narrowIntegerColumns(connection, tableDefinitionData, csvStageTable);
+                }
+                catalog.createTable(tableDefinitionData);
+
+                std::string selectList;
+                for (const auto& column : tableDefinitionData.getColumns()) {
+                    const auto name = column.getName().toString();
+                    selectList += (selectList.empty() ? "" : ", ") +
+                                  ("CAST(" + name + " AS " + column.getType().toString() + ")");
+                }
+                std::string orderBy;
+                for (const auto& clusterColumn : loadOptions.clusterColumns) {
+                    orderBy += (orderBy.empty() ? " ORDER BY " : ", ") + hyperapi::escapeName(clusterColumn);
+                }
+
+                std::cout << "Copying the staged rows into the table" << (orderBy.empty() ? "." : ", sorted by the cluster columns.") << std::endl;
+                rowCount = connection.executeCommand(
+                    "INSERT INTO " + tableDefinitionData.getTableName().toString() + " SELECT " + selectList +
+                    " FROM " + csvStageTable.toString() + orderBy);
+                connection.executeCommand("DROP TABLE " + csvStageTable.toString());
+            }
+
             std::cout << "The number of rows in table " << tableDefinitionData.getTableName() << " is " << rowCount << "." << std::endl;
         }
 
@@ -179,9 +231,128 @@ hyperapi::SqlType inferType(const std::vector<std::string>& sampleData) {
     return sqlType;
 }
 
+// Picks the smallest integer type holding every staged value of each BIGINT column,
+// computed for all columns in a single scan of the stage.
+hyperapi::TableDefinition narrowIntegerColumns(hyperapi::Connection& connection,
+                                               const hyperapi::TableDefinition& tableDefinition,
+                                               const hyperapi::TableName& stageTable) {
+    std::vector<size_t> candidates;
+    std::string widths;
+    for (size_t i = 0; i < tableDefinition.getColumnCount(); ++i) {
+        const auto& column = tableDefinition.getColumn(i);
+        if (column.getType().getTag() != hyperapi::TypeTag::BigInt) {
+            continue;
+        }
+        const auto name = column.getName().toString();
+        widths += (widths.empty() ? "" : ", ") +
+                  ("CASE WHEN MIN(" + name + ") >= -32768 AND MAX(" + name + ") <= 32767 THEN 2"
+                   " WHEN MIN(" + name + ") >= -2147483648 AND MAX(" + name + ") <= 2147483647 THEN 4"
+                   " ELSE 8 END");
+        candidates.push_back(i);
+    }
+    if (candidates.empty()) {
+        return tableDefinition;
+    }
+
+    std::vector<int32_t> columnWidths;
+    for (const hyperapi::Row& row : connection.executeQuery("SELECT " + widths + " FROM " + stageTable.toString())) {
+        for (size_t i = 0; i < candidates.size(); ++i) {
+            columnWidths.push_back(row.get<int32_t>(i));
+        }
+    }
+
+    std::vector<hyperapi::TableDefinition::Column> columns = tableDefinition.getColumns();
+    for (size_t i = 0; i < candidates.size() && i < columnWidths.size(); ++i) {
+        auto& column = columns[candidates[i]];
+        if (columnWidths[i] == 8) {
+            continue;
+        }
+        const auto narrowed = columnWidths[i] == 2 ? hyperapi::SqlType::smallInt() : hyperapi::SqlType::integer();
+        std::cout << "Narrowing column " << column.getName() << " to " << narrowed.toString() << "." << std::endl;
+        column = hyperapi::TableDefinition::Column(column.getName(), narrowed, column.getNullability());
+    }
+
+    return hyperapi::TableDefinition(tableDefinition.getTableName(), columns, tableDefinition.getPersistence());
+}
+
 bool isBoolean(const std::string& value) {
     std::string lowerCaseValue = value;
     std::transform(lowerCaseValue.begin(), lowerCaseValue.end(), lowerCaseValue.begin(), ::tolower);
 
     return lowerCaseValue == "true" || lowerCaseValue == "false";
 }
+
+namespace {
+    const hyperapi::TableName upsertStageTable("toiya_upsert_stage");
+}
+
+int64_t appendArrowToHyper(const std::string& hyperFilePath,
+                           const std::string& tableName,
+                           struct ArrowArrayStream* stream,
+                           const ArrowWriteOptions& options) {
+    auto connection = GetHyperSession(options.hyperPath).Acquire(hyperFilePath);
+
+    try {
+        const auto table = connection->getCatalog().getTableDefinition(ParseTableName(tableName));
+        return InsertArrowStream(*connection, table, stream, options.commitRows);
+    } catch (...) {
+        // A failed inserter can leave the connection mid-COPY.
+        connection.Discard();
+        throw;
+    }
+}
+
+int64_t upsertArrowToHyper(const std::string& hyperFilePath,
+                           const std::string& tableName,
+                           const std::vector<std::string>& keyColumns,
+                           struct ArrowArrayStream* stream,
+                           const ArrowWriteOptions& options) {
+    if (keyColumns.empty()) {
+        throw std::invalid_argument("upsert requires at least one key column.");
+    }
+
+    auto connection = GetHyperSession(options.hyperPath).Acquire(hyperFilePath);
+
+    try {
+        const auto table = connection->getCatalog().getTableDefinition(ParseTableName(tableName));
+        const auto target = table.getTableName().toString();
+        const auto stage = upsertStageTable.toString();
+
+        std::string keysMatch;
+        for (const auto& key : keyColumns) {
+            if (!table.getColumnPositionByName(hyperapi::Name(key))) {
+                throw std::invalid_argument("Key column does not exist in the table: " + key);
+            }
+            const auto name = hyperapi::Name(key).toString();
+            keysMatch += (keysMatch.empty() ? "" : " AND ") + std::string("s.") + name + " = t." + name;
+        }
+
+        std::string columnList;
+        for (const auto& column : table.getColumns()) {
+            columnList += (columnList.empty() ? "" : ", ") + column.getName().toString();
+        }
+
+        // Rows are staged in a temporary table and merged in one transaction per commit.
+        hyperapi::TableDefinition stageDefinition(upsertStageTable, table.getColumns(), hyperapi::Persistence::Temporary);
+        connection->executeCommand("DROP TABLE IF EXISTS " + stage);
+        connection->getCatalog().createTable(stageDefinition);
+
+        const auto merge = [&] {
+            connection->executeCommand("BEGIN TRANSACTION");
+            connection->executeCommand("DELETE FROM " + target + " AS t WHERE EXISTS (SELECT 1 FROM " + stage +
+                                       " AS s WHERE " + keysMatch + ")");
+            connection->executeCommand("INSERT INTO " + target + " (" + columnList + ") SELECT " + columnList +
+                                       " FROM " + stage);
+            connection->executeCommand("COMMIT");
+            connection->executeCommand("DELETE FROM " + stage);
+        };
+
+        const auto rowCount = InsertArrowStream(*connection, stageDefinition, stream, options.commitRows, merge);
+        connection->executeCommand("DROP TABLE " + stage);
+        return rowCount;
+    } catch (...) {
+        // Closing the connection rolls back the open transaction and drops the stage.
+        connection.Discard();
+        throw;
+    }
+}
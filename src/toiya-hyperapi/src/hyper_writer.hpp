@@ -2,11 +2,46 @@
 
 #include <string>
 #include <optional>
+#include <vector>
 #include <hyperapi/hyperapi.hpp>
 
+#include "toiya.h"
+
+struct CsvLoadOptions {
+    // Columns the table is sorted by once loaded, so that range filters on them
+    // skip most of the file. Empty keeps the rows in file order.
+    std::vector<std::string> clusterColumns;
+    // Stores BIGINT columns as SMALLINT or INTEGER when every loaded value fits.
+    bool narrowTypes = false;
+};
+
 void createHyperFileFromCsv(const std::string& csvFilePath,
                             const std::string& hyperFilePath,
                             const std::optional<hyperapi::TableDefinition>& tableDefinition = std::nullopt,
                             const std::string& tableName = "Untitled",
                             char delimiter = ',',
-                            int databaseVersion = 0);
+                            int databaseVersion = 0,
+                            const CsvLoadOptions& loadOptions = {});
+
+struct ArrowWriteOptions {
+    // Rows per transaction. 0 writes the whole stream in one transaction.
+    int64_t commitRows = 0;
+    // Directory containing the hyperd executable, see GetHyperSession.
+    std::string hyperPath;
+};
+
+// Appends every batch of stream to an existing table and returns the number of rows
+// written. Arrow columns are matched to table columns by name. The stream is read to
+// the end but not released. tableName may be schema qualified, see ParseTableName.
+int64_t appendArrowToHyper(const std::string& hyperFilePath,
+                           const std::string& tableName,
+                           struct ArrowArrayStream* stream,
+                           const ArrowWriteOptions& options = {});
+
+// Like appendArrowToHyper, but rows whose keyColumns equal those of an incoming row
+// are replaced by it. Keys should be unique within one commit; NULL keys never match.
+int64_t upsertArrowToHyper(const std::string& hyperFilePath,
+                           const std::string& tableName,
+                           const std::vector<std::string>& keyColumns,
+                           struct ArrowArrayStream* stream,
+                           const ArrowWriteOptions& options = {});
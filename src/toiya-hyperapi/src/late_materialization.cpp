@@ -0,0 +1,389 @@
+#include "late_materialization.hpp"
+#include "arrow_to_hyper.hpp"
+#include "hyper_session.hpp"
+#include "query_canceller.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <hyperapi/hyperapi.hpp>
+#include <nanoarrow/nanoarrow.hpp>
+
+namespace {
+    const auto kKeysTable = hyperapi::TableName("toiya_late_keys");
+    const auto kRowColumn = hyperapi::Name("toiya_row");
+
+    // The query's batch with the looked up columns appended. Both batches stay alive
+    // under a parent that borrows their children.
+    struct StitchedBatchPrivate {
+        struct ArrowArray batch {};
+        struct ArrowArray looked_up {};
+        std::vector<struct ArrowArray*> children;
+        const void* buffers[1] = {nullptr};
+    };
+
+    auto ReleaseStitchedBatch(struct ArrowArray* array) -> void {
+        auto private_data = static_cast<StitchedBatchPrivate*>(array -> private_data);
+        if (private_data -> batch.release != nullptr) {
+            ArrowArrayRelease(&private_data -> batch);
+        }
+        if (private_data -> looked_up.release != nullptr) {
+            ArrowArrayRelease(&private_data -> looked_up);
+        }
+        delete private_data;
+        array -> release = nullptr;
+    }
+
+    // Row numbers 0 .. length - 1 that tie every looked up row to its query row.
+    auto MakeRowNumbers(int64_t length, struct ArrowArray* out) -> void {
+        if (ArrowArrayInitFromType(out, NANOARROW_TYPE_INT64) || ArrowArrayStartAppending(out) ||
+            ArrowArrayReserve(out, length)) {
+            throw std::bad_alloc();
+        }
+        for (int64_t i = 0; i < length; i++) {
+            if (ArrowArrayAppendInt(out, i)) {
+                throw std::bad_alloc();
+            }
+        }
+        struct ArrowError error {};
+        if (ArrowArrayFinishBuildingDefault(out, &error)) {
+            throw std::runtime_error(error.message);
+        }
+    }
+
+    // Struct schema holding copies of first's children followed by second's, skipping
+    // the first skip_second of them.
+    auto ConcatenateSchemas(const struct ArrowSchema* first, const struct ArrowSchema* second,
+                            int64_t skip_second, struct ArrowSchema* out) -> void {
+        ArrowSchemaInit(out);
+        if (ArrowSchemaSetTypeStruct(out, first -> n_children + second -> n_children - skip_second)) {
+            throw std::bad_alloc();
+        }
+        int64_t position = 0;
+        for (const auto* schema : {first, second}) {
+            for (int64_t i = schema == second ? skip_second : 0; i < schema -> n_children; i++, position++) {
+                ArrowSchemaRelease(out -> children[position]);
+                if (ArrowSchemaDeepCopy(schema -> children[i], out -> children[position])) {
+                    throw std::bad_alloc();
+                }
+            }
+        }
+    }
+
+    class LateMaterializedStream final : private ConnectionPool {
+    public:
+        LateMaterializedStream(const std::string& path,
+                               const std::string& query,
+                               const LateMaterializationOptions& options);
+        LateMaterializedStream(const LateMaterializedStream&) = delete;
+        LateMaterializedStream &operator=(const LateMaterializedStream&) = delete;
+        ~LateMaterializedStream() = default;
+
+        auto Canceller() const -> std::shared_ptr<QueryCanceller> { return canceller_; }
+
+        auto GetSchema(struct ArrowSchema* out) -> int {
+            return ArrowSchemaDeepCopy(schema_.get(), out);
+        }
+
+        auto GetNext(struct ArrowArray* out) -> int {
+            try {
+                nanoarrow::UniqueArray batch;
+                do {
+                    batch.reset();
+                    if (const auto errcode = source_ -> get_next(source_.get(), batch.get()); errcode != 0) {
+                        const char* message = source_ -> get_last_error(source_.get());
+                        ArrowErrorSetString(&error_, message != nullptr ? message : "query failed");
+                        return errcode;
+                    }
+                    if (batch -> release == nullptr) {
+                        out -> release = nullptr;
+                        return 0;
+                    }
+                } while (batch -> length == 0);
+
+                nanoarrow::UniqueArray looked_up;
+                LookUp(batch.get(), looked_up.get());
+                Stitch(std::move(batch), std::move(looked_up), out);
+                return 0;
+            } catch (...) {
+                return stream_error_from_exception(&error_);
+            }
+        }
+
+        auto GetLastError() const -> const char* {
+            return error_.message;
+        }
+
+    private:
+        auto Return(const std::string&,
+                    std::unique_ptr<hyperapi::Connection> connection,
+                    std::unique_ptr<PreparedStatements>) noexcept -> void override {
+            if (connection -> isOpen()) {
+                lookup_ = std::move(connection);
+            }
+        }
+
+        // Replaces the keys on the lookup connection with those of batch.
+        auto LoadKeys(const struct ArrowArray* batch) -> void {
+            if (!lookup_) {
+                throw std::runtime_error("the lookup connection was lost");
+            }
+            lookup_ -> executeCommand("TRUNCATE TABLE " + kKeysTable.toString());
+
+            nanoarrow::UniqueArray row_numbers;
+            MakeRowNumbers(batch -> length, row_numbers.get());
+
+            std::vector<struct ArrowArray*> children;
+            for (const auto index : key_indices_) {
+                children.push_back(batch -> children[index]);
+            }
+            children.push_back(row_numbers.get());
+
+            // Only borrows the children, the inserter does not take ownership.
+            const void* buffers[1] = {nullptr};
+            struct ArrowArray keys {};
+            keys.length = batch -> length;
+            keys.offset = 0;
+            keys.n_buffers = 1;
+            keys.buffers = buffers;
+            keys.n_children = static_cast<int64_t>(children.size());
+            keys.children = children.data();
+            keys.release = [](struct ArrowArray* array) { array -> release = nullptr; };
+
+            ArrowBatchInserter inserter(*lookup_, keys_table_, keys_schema_.get());
+            inserter.Insert(&keys);
+            inserter.Commit();
+        }
+
+        // Runs the lookup query over the loaded keys into a single batch, within what
+        // is left of the stream's deadline and cancelled along with the stream.
+        auto ReadLookup(struct ArrowSchema* schema, struct ArrowArray* array) -> void {
+            if (!lookup_) {
+                throw std::runtime_error("the lookup connection was lost");
+            }
+            if (deadline_) {
+                const auto remaining =
+                    std::chrono::ceil<std::chrono::milliseconds>(*deadline_ - std::chrono::steady_clock::now());
+                if (remaining.count() <= 0) {
+                    throw QueryCancelledError(QueryCanceller::Reason::DeadlineExceeded);
+                }
+                lookup_options_.timeout = remaining;
+            }
+
+            read_single_batch(PooledConnection(this, "", std::move(lookup_)), lookup_query_, lookup_options_,
+                              schema, array, canceller_);
+        }
+
+        auto LookUp(const struct ArrowArray* batch, struct ArrowArray* out) -> void {
+            // The row numbers and the looked up columns start at 0, so batch has to.
+            if (batch -> offset != 0) {
+                throw std::invalid_argument("late materialization needs query batches without an offset");
+            }
+            LoadKeys(batch);
+
+            nanoarrow::UniqueSchema schema;
+            ReadLookup(schema.get(), out);
+
+            // The first column repeats the row numbers, which catches keys that match
+            // no row or several rows even when the counts happen to agree.
+            const int64_t rows = out -> release != nullptr ? out -> length : 0;
+            bool aligned = rows == batch -> length;
+            if (aligned) {
+                const auto row_numbers = out -> children[0];
+                const auto values = static_cast<const int64_t*>(row_numbers -> buffers[1]) + row_numbers -> offset;
+                for (int64_t i = 0; i < rows && aligned; i++) {
+                    aligned = values[i] == i;
+                }
+            }
+            if (!aligned) {
+                throw std::invalid_argument("the key columns do not match exactly one row of " + table_ +
+                                            " for every row of the query");
+            }
+        }
+
+        auto Stitch(nanoarrow::UniqueArray batch, nanoarrow::UniqueArray looked_up, struct ArrowArray* out) -> void {
+            auto private_data = std::make_unique<StitchedBatchPrivate>();
+            batch.move(&private_data -> batch);
+            looked_up.move(&private_data -> looked_up);
+
+            auto& children = private_data -> children;
+            children.assign(private_data -> batch.children,
+                            private_data -> batch.children + private_data -> batch.n_children);
+            children.insert(children.end(), private_data -> looked_up.children + 1,
+                            private_data -> looked_up.children + private_data -> looked_up.n_children);
+
+            out -> length = private_data -> batch.length;
+            out -> null_count = 0;
+            out -> offset = 0;
+            out -> n_buffers = 1;
+            out -> buffers = private_data -> buffers;
+            out -> n_children = static_cast<int64_t>(children.size());
+            out -> children = children.data();
+            out -> dictionary = nullptr;
+            out -> release = ReleaseStitchedBatch;
+            out -> private_data = private_data.release();
+        }
+
+        std::string table_;
+        nanoarrow::UniqueArrayStream source_;
+        // Covers the query and every lookup, see Result::canceller.
+        std::shared_ptr<QueryCanceller> canceller_;
+        std::optional<std::chrono::steady_clock::time_point> deadline_;
+        std::unique_ptr<hyperapi::Connection> lookup_;
+        std::vector<int64_t> key_indices_;
+        nanoarrow::UniqueSchema keys_schema_;
+        hyperapi::TableDefinition keys_table_{kKeysTable};
+        std::string lookup_query_;
+        ReadOptions lookup_options_;
+        nanoarrow::UniqueSchema schema_;
+        struct ArrowError error_ {};
+    };
+
+    LateMaterializedStream::LateMaterializedStream(const std::string& path,
+                                                   const std::string& query,
+                                                   const LateMaterializationOptions& options)
+        : table_(options.table), canceller_(std::make_shared<QueryCanceller>(nullptr)) {
+        if (options.key_columns.empty()) {
+            throw std::invalid_argument("late materialization needs at least one key column");
+        }
+
+        // The timeout bounds the whole stream, so lookups only get what is left of it.
+        if (options.read.timeout.count() > 0) {
+            deadline_ = std::chrono::steady_clock::now() + options.read.timeout;
+            CancelAtDeadline(canceller_, *deadline_);
+        }
+
+        const auto endpoint = GetHyperSession(options.read.hyper_path).Process().getEndpoint();
+        // Not taken from the pool: the keys table must not leak into later users.
+        lookup_ = std::make_unique<hyperapi::Connection>(endpoint, path);
+
+        // Stitched batches carry no statistics, so the query does not collect any.
+        auto query_options = options.read;
+        query_options.compute_statistics = false;
+        auto first_phase = read_from_hyper_query(path, query, query_options);
+        ArrowArrayStreamMove(static_cast<struct ArrowArrayStream*>(const_cast<void*>(first_phase.data)), source_.get());
+        first_phase.release(const_cast<void*>(first_phase.data));
+        if (first_phase.canceller) {
+            canceller_ -> Forward(first_phase.canceller);
+        }
+
+        nanoarrow::UniqueSchema query_schema;
+        if (source_ -> get_schema(source_.get(), query_schema.get()) != 0) {
+            const char* message = source_ -> get_last_error(source_.get());
+            throw std::runtime_error(message != nullptr ? message : "Failed to read the query schema.");
+        }
+
+        // The keys table holds the key columns of one batch and their row numbers.
+        ArrowSchemaInit(keys_schema_.get());
+        if (ArrowSchemaSetTypeStruct(keys_schema_.get(), static_cast<int64_t>(options.key_columns.size()) + 1)) {
+            throw std::bad_alloc();
+        }
+        std::string join_condition;
+        for (size_t i = 0; i < options.key_columns.size(); i++) {
+            const auto& key = options.key_columns[i];
+            const auto children = query_schema -> children;
+            const auto found = std::find_if(children, children + query_schema -> n_children, [&](const auto* child) {
+                return child -> name != nullptr && key == child -> name;
+            });
+            if (found == children + query_schema -> n_children) {
+                throw std::invalid_argument("the query does not return the key column " + key);
+            }
+            key_indices_.push_back(found - children);
+
+            ArrowSchemaRelease(keys_schema_ -> children[i]);
+            if (ArrowSchemaDeepCopy(*found, keys_schema_ -> children[i])) {
+                throw std::bad_alloc();
+            }
+
+            const auto name = hyperapi::Name(key).toString();
+            join_condition += (i > 0 ? " AND " : "") + ("toiya_keys." + name + " = toiya_table." + name);
+        }
+        auto row_schema = keys_schema_ -> children[options.key_columns.size()];
+        ArrowSchemaRelease(row_schema);
+        if (ArrowSchemaInitFromType(row_schema, NANOARROW_TYPE_INT64) ||
+            ArrowSchemaSetName(row_schema, kRowColumn.getUnescaped().c_str())) {
+            throw std::bad_alloc();
+        }
+        row_schema -> flags = 0;
+
+        keys_table_ = MakeTableDefinitionFromArrow(keys_schema_.get(), kKeysTable, hyperapi::Persistence::Temporary);
+        lookup_ -> getCatalog().createTable(keys_table_);
+
+        auto columns = options.columns;
+        if (columns.empty()) {
+            const auto definition = lookup_ -> getCatalog().getTableDefinition(ParseTableName(options.table));
+            for (const auto& column : definition.getColumns()) {
+                const auto& name = column.getName().getUnescaped();
+                const auto children = query_schema -> children;
+                if (std::none_of(children, children + query_schema -> n_children, [&](const auto* child) {
+                        return child -> name != nullptr && name == child -> name;
+                    })) {
+                    columns.push_back(name);
+                }
+            }
+        }
+        if (columns.empty()) {
+            throw std::invalid_argument("the query already returns every column of " + options.table);
+        }
+
+        std::string column_list = "toiya_keys." + kRowColumn.toString();
+        for (const auto& column : columns) {
+            column_list += ", toiya_table." + hyperapi::Name(column).toString();
+        }
+        lookup_query_ = "SELECT " + column_list + " FROM " + kKeysTable.toString() + " AS toiya_keys JOIN " +
+                        ParseTableName(options.table).toString() + " AS toiya_table ON " + join_condition +
+                        " ORDER BY toiya_keys." + kRowColumn.toString();
+
+        lookup_options_ = options.read;
+        lookup_options_.timeout = std::chrono::milliseconds{0};
+        lookup_options_.compute_statistics = false;
+        lookup_options_.nullability_table.clear();
+        lookup_options_.not_null_columns.clear();
+
+        // Looking up the still empty keys table yields the schema of the second phase
+        // and checks the lookup query before the first batch.
+        nanoarrow::UniqueSchema lookup_schema;
+        nanoarrow::UniqueArray empty;
+        ReadLookup(lookup_schema.get(), empty.get());
+        ConcatenateSchemas(query_schema.get(), lookup_schema.get(), 1, schema_.get());
+    }
+}
+
+auto read_late_materialized(const std::string& path,
+                            const std::string& query,
+                            const LateMaterializationOptions& options)-> Result {
+    auto late = std::make_unique<LateMaterializedStream>(path, query, options);
+    auto canceller = late -> Canceller();
+
+    struct ArrowArrayStream stream {};
+    stream.private_data = late.release();
+    stream.get_schema = [](struct ArrowArrayStream* stream, struct ArrowSchema* out) {
+        return static_cast<LateMaterializedStream*>(stream -> private_data) -> GetSchema(out);
+    };
+    stream.get_next = [](struct ArrowArrayStream* stream, struct ArrowArray* out) {
+        return static_cast<LateMaterializedStream*>(stream -> private_data) -> GetNext(out);
+    };
+    stream.get_last_error = [](struct ArrowArrayStream* stream) {
+        return static_cast<LateMaterializedStream*>(stream -> private_data) -> GetLastError();
+    };
+    stream.release = [](struct ArrowArrayStream* stream) {
+        delete static_cast<LateMaterializedStream*>(stream -> private_data);
+        stream -> release = nullptr;
+    };
+
+    Result result;
+    try {
+        result = make_stream_result(&stream);
+    } catch (...) {
+        stream.release(&stream);
+        throw;
+    }
+    result.canceller = std::move(canceller);
+    return result;
+}
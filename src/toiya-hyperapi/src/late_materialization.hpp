@@ -0,0 +1,32 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "reader_sample.hpp"
+
+struct LateMaterializationOptions {
+    // Table the remaining columns are looked up in, see ParseTableName.
+    std::string table;
+    // Columns of table that identify one of its rows. The query must return them.
+    std::vector<std::string> key_columns;
+    // Columns of table fetched in the second phase. Empty fetches every column of
+    // table that the query does not return itself.
+    std::vector<std::string> columns;
+    // Used for the query; its batches are the unit of every lookup, so chunk_size
+    // bounds the keys per lookup. Lookups are read as single batches. timeout covers
+    // the query and all lookups together. compute_statistics is ignored; the stream
+    // has no statistics.
+    ReadOptions read{};
+};
+
+// Reads the rows selected by query in two phases, so that wide columns are only
+// transferred and decoded for the rows that survive a filter or a top-N. The query
+// returns the key columns and whatever it filters or sorts by, e.g.
+// "SELECT id, score FROM t ORDER BY score DESC LIMIT 100". Each of its batches is
+// then extended with the remaining columns of the same rows, looked up by key in
+// table on a dedicated connection and kept in the query's row order. Every key has
+// to match exactly one row of table; NULL keys match none.
+auto read_late_materialized(const std::string& path,
+                            const std::string& query,
+                            const LateMaterializationOptions& options)-> Result;
@@ -0,0 +1,118 @@
+#include "prepared_query.hpp"
+#include "hyper_session.hpp"
+#include "query_canceller.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <locale>
+#include <sstream>
+#include <string>
+#include <type_traits>
+#include <variant>
+
+namespace {
+
+// Statements kept per connection before they are all deallocated.
+constexpr size_t kMaxPreparedPerConnection = 64;
+
+auto RenderLiteral(const QueryParameter& parameter) -> std::string {
+    if (!parameter.value) {
+        return "NULL";
+    }
+
+    return std::visit([](const auto& value) -> std::string {
+        using T = std::decay_t<decltype(value)>;
+        if constexpr (std::is_same_v<T, bool>) {
+            return value ? "TRUE" : "FALSE";
+        } else if constexpr (std::is_same_v<T, int64_t>) {
+            return std::to_string(value);
+        } else if constexpr (std::is_same_v<T, double>) {
+            if (std::isnan(value)) {
+                return "'NaN'";
+            }
+            if (std::isinf(value)) {
+                return value > 0 ? "'Infinity'" : "'-Infinity'";
+            }
+            std::ostringstream literal;
+            literal.imbue(std::locale::classic());
+            literal << std::setprecision(17) << value;
+            return literal.str();
+        } else {
+            return hyperapi::escapeStringLiteral(value);
+        }
+    }, *parameter.value);
+}
+
+} // namespace
+
+auto read_from_hyper_prepared(const std::string& path,
+                              const std::string& query,
+                              const std::vector<QueryParameter>& parameters,
+                              const ReadOptions& options)-> Result {
+    std::string types;
+    std::string arguments;
+    for (const auto& parameter : parameters) {
+        types += (types.empty() ? "" : ", ") + parameter.type.toString();
+        arguments += (arguments.empty() ? "" : ", ") + RenderLiteral(parameter);
+    }
+    if (!parameters.empty()) {
+        types = " (" + types + ")";
+        arguments = " (" + arguments + ")";
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    auto connection = GetHyperSession(options.hyper_path).Acquire(path);
+    auto& prepared = connection.Prepared();
+
+    // The same text prepared with other parameter types is another statement.
+    const auto key = types + "\n" + query;
+    auto statement = prepared.names.find(key);
+    if (statement == prepared.names.end()) {
+        // Planning counts against the timeout like running the query does. A statement
+        // cut short leaves the connection in an unknown state, so it is not pooled.
+        const auto canceller = std::make_shared<QueryCanceller>(&*connection);
+        if (options.timeout.count() > 0) {
+            CancelAtDeadline(canceller, start + options.timeout);
+        }
+
+        try {
+            if (prepared.names.size() >= kMaxPreparedPerConnection) {
+                connection -> executeCommand("DEALLOCATE ALL");
+                prepared.names.clear();
+            }
+
+            const auto name = "toiya_statement_" + std::to_string(prepared.next_id++);
+            connection -> executeCommand("PREPARE " + name + types + " AS " + query);
+            statement = prepared.names.emplace(key, name).first;
+        } catch (const hyperapi::HyperException&) {
+            canceller -> Detach();
+            if (const auto reason = canceller -> GetReason(); reason != QueryCanceller::Reason::None) {
+                connection.Discard();
+                throw QueryCancelledError(reason);
+            }
+            throw;
+        }
+        canceller -> Detach();
+        if (const auto reason = canceller -> GetReason(); reason != QueryCanceller::Reason::None) {
+            connection.Discard();
+            throw QueryCancelledError(reason);
+        }
+    }
+    const auto execute = "EXECUTE " + statement -> second + arguments;
+
+    auto effective_options = options;
+    if (options.timeout.count() > 0) {
+        // What is left of the timeout, at least 1ms since 0 would mean none.
+        const auto spent = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - start);
+        effective_options.timeout = std::max(options.timeout - spent, std::chrono::milliseconds{1});
+    }
+    if (options.single_batch) {
+        effective_options.chunk_size = 0;
+        effective_options.target_batch_bytes = 0;
+    }
+
+    return read_from_hyper_connection(std::move(connection), execute, effective_options);
+}
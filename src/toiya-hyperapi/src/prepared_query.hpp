@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <variant>
+#include <vector>
+
+#include <hyperapi/hyperapi.hpp>
+
+#include "reader_sample.hpp"
+
+// A value bound to a $n placeholder of a prepared query. It is sent as an escaped
+// literal and converted to type by Hyper, so strings may carry e.g. dates as ISO text.
+struct QueryParameter {
+    hyperapi::SqlType type;
+    // std::nullopt binds NULL.
+    std::optional<std::variant<bool, int64_t, double, std::string>> value;
+};
+
+// Runs query, with $1, $2, ... standing for parameters, as a server-side prepared
+// statement on a pooled connection. The statement is prepared once per connection
+// and parameter types and reused by later calls, so that Hyper parses and plans the
+// query only once. options.timeout covers preparing the statement as well, but
+// Result::canceller only exists once it runs. With options.single_batch the result is fetched without chunked
+// mode and emitted as one batch, which suits small results best. The result cache
+// is not consulted.
+auto read_from_hyper_prepared(const std::string& path,
+                              const std::string& query,
+                              const std::vector<QueryParameter>& parameters,
+                              const ReadOptions& options)-> Result;
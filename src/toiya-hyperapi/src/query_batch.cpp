@@ -0,0 +1,76 @@
+#include "query_batch.hpp"
+
+#include <algorithm>
+
+QueryBatch::QueryBatch(std::vector<QuerySpec> queries, ReadOptions options, size_t max_concurrency)
+    : queries_(std::move(queries)), options_(std::move(options)) {
+    const auto worker_count = std::min(std::max<size_t>(max_concurrency, 1), queries_.size());
+
+    try {
+        workers_.reserve(worker_count);
+        for (size_t i = 0; i < worker_count; i++) {
+            workers_.emplace_back(&QueryBatch::Work, this);
+        }
+    } catch (...) {
+        stopping_ = true;
+        for (auto& worker : workers_) {
+            worker.join();
+        }
+        throw;
+    }
+}
+
+QueryBatch::~QueryBatch() {
+    stopping_ = true;
+    for (auto& worker : workers_) {
+        worker.join();
+    }
+
+    for (auto& ready : ready_) {
+        if (ready.result.release != nullptr) {
+            ready.result.release(const_cast<void*>(ready.result.data));
+        }
+    }
+}
+
+auto QueryBatch::Work() -> void {
+    while (!stopping_) {
+        const auto index = next_query_.fetch_add(1);
+        if (index >= queries_.size()) {
+            return;
+        }
+
+        // A worker moves on once Hyper delivered the first chunk, which is when
+        // blocking operators such as sorts and aggregations have done their work.
+        // Waiting for the stream to end would hang callers that collect every
+        // stream before reading any of them.
+        ReadyQuery ready{index, {}, nullptr};
+        try {
+            const auto& spec = queries_[index];
+            ready.result = read_from_hyper_query(spec.path, spec.query, options_);
+        } catch (...) {
+            ready.error = std::current_exception();
+        }
+
+        {
+            const std::lock_guard lock(mutex_);
+            ready_.push_back(std::move(ready));
+        }
+        ready_cv_.notify_one();
+    }
+}
+
+auto QueryBatch::NextReady() -> std::optional<ReadyQuery> {
+    std::unique_lock lock(mutex_);
+    if (handed_out_ == queries_.size()) {
+        return std::nullopt;
+    }
+
+    ready_cv_.wait(lock, [this] { return !ready_.empty(); });
+
+    auto ready = std::move(ready_.front());
+    ready_.pop_front();
+    handed_out_++;
+
+    return ready;
+}
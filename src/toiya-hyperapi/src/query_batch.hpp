@@ -0,0 +1,59 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "reader_sample.hpp"
+
+struct QuerySpec {
+    std::string path;
+    std::string query;
+};
+
+struct ReadyQuery {
+    // Position of the query in the list passed to QueryBatch.
+    size_t index;
+    // Owns the stream; data is nullptr when the query failed.
+    Result result;
+    std::exception_ptr error;
+};
+
+// Runs independent queries concurrently on pooled connections and hands out each
+// stream as soon as Hyper delivered its first chunk. At most max_concurrency
+// queries are executed up to their first chunk at any time. Handed out streams do
+// not count and keep their connection until they are released, so they may be
+// read in any order or collected before reading.
+class QueryBatch {
+public:
+    QueryBatch(std::vector<QuerySpec> queries, ReadOptions options, size_t max_concurrency);
+    QueryBatch(const QueryBatch&) = delete;
+    QueryBatch &operator=(const QueryBatch&) = delete;
+    ~QueryBatch();
+
+    // Blocks until another query is ready. Returns std::nullopt once every query
+    // has been handed out.
+    auto NextReady() -> std::optional<ReadyQuery>;
+
+private:
+    auto Work() -> void;
+
+    std::vector<QuerySpec> queries_;
+    ReadOptions options_;
+    std::atomic<size_t> next_query_{0};
+    std::atomic<bool> stopping_{false};
+
+    std::mutex mutex_;
+    std::condition_variable ready_cv_;
+    std::deque<ReadyQuery> ready_;
+    size_t handed_out_ = 0;
+
+    std::vector<std::thread> workers_;
+};
@@ -0,0 +1,173 @@
+#include "query_canceller.hpp"
+
+#include <condition_variable>
+#include <map>
+#include <set>
+#include <thread>
+#include <utility>
+
+namespace {
+    // A single thread that sleeps until the earliest deadline.
+    class DeadlineWatchdog {
+    public:
+        DeadlineWatchdog() : thread_(&DeadlineWatchdog::Run, this) {}
+
+        ~DeadlineWatchdog() {
+            {
+                const std::lock_guard lock(mutex_);
+                stopping_ = true;
+            }
+            cv_.notify_one();
+            thread_.join();
+        }
+
+        // Returns a non-zero id for Unschedule.
+        auto Schedule(std::weak_ptr<QueryCanceller> canceller, std::chrono::steady_clock::time_point deadline) -> uint64_t {
+            uint64_t id = 0;
+            {
+                const std::lock_guard lock(mutex_);
+                id = ++last_id_;
+                order_.emplace(deadline, id);
+                entries_.emplace(id, Entry{deadline, std::move(canceller)});
+            }
+            cv_.notify_one();
+            return id;
+        }
+
+        // Drops a deadline that is no longer needed, so that finished queries do not
+        // pile up until their deadline passes.
+        auto Unschedule(uint64_t id) -> void {
+            const std::lock_guard lock(mutex_);
+            const auto entry = entries_.find(id);
+            if (entry != entries_.end()) {
+                order_.erase({entry -> second.deadline, id});
+                entries_.erase(entry);
+            }
+        }
+
+    private:
+        struct Entry {
+            std::chrono::steady_clock::time_point deadline;
+            std::weak_ptr<QueryCanceller> canceller;
+        };
+
+        auto Run() -> void {
+            std::unique_lock lock(mutex_);
+            while (!stopping_) {
+                if (order_.empty()) {
+                    cv_.wait(lock);
+                    continue;
+                }
+
+                const auto [deadline, id] = *order_.begin();
+                if (std::chrono::steady_clock::now() < deadline) {
+                    cv_.wait_until(lock, deadline);
+                    continue;
+                }
+
+                const auto entry = entries_.find(id);
+                auto canceller = entry -> second.canceller.lock();
+                order_.erase(order_.begin());
+                entries_.erase(entry);
+                if (canceller) {
+                    lock.unlock();
+                    canceller -> Cancel(QueryCanceller::Reason::DeadlineExceeded);
+                    // The last owner may be this one, and its destructor unschedules.
+                    canceller.reset();
+                    lock.lock();
+                }
+            }
+        }
+
+        std::mutex mutex_;
+        std::condition_variable cv_;
+        // Deadlines in the order they pass, each with the id of its entry.
+        std::set<std::pair<std::chrono::steady_clock::time_point, uint64_t>> order_;
+        std::map<uint64_t, Entry> entries_;
+        uint64_t last_id_ = 0;
+        bool stopping_ = false;
+        // Started last, once everything it touches exists.
+        std::thread thread_;
+    };
+
+    auto GetDeadlineWatchdog() -> DeadlineWatchdog& {
+        static DeadlineWatchdog watchdog;
+
+        return watchdog;
+    }
+}
+
+QueryCanceller::~QueryCanceller() {
+    Unschedule();
+}
+
+auto QueryCanceller::Cancel(Reason reason) noexcept -> void {
+    std::vector<std::weak_ptr<QueryCanceller>> targets;
+    {
+        const std::lock_guard lock(mutex_);
+        if (reason_ != Reason::None) {
+            return;
+        }
+        reason_ = reason;
+        targets.swap(targets_);
+
+        // Hyper allows this from any thread while another one is fetching.
+        if (connection_ != nullptr) {
+            connection_ -> cancel();
+        }
+    }
+
+    for (const auto& target : targets) {
+        if (const auto locked = target.lock()) {
+            locked -> Cancel(reason);
+        }
+    }
+}
+
+auto QueryCanceller::GetReason() const noexcept -> Reason {
+    const std::lock_guard lock(mutex_);
+    return reason_;
+}
+
+auto QueryCanceller::Detach() noexcept -> void {
+    {
+        const std::lock_guard lock(mutex_);
+        connection_ = nullptr;
+    }
+    Unschedule();
+}
+
+auto QueryCanceller::Forward(const std::shared_ptr<QueryCanceller>& target) -> void {
+    Reason reason = Reason::None;
+    {
+        const std::lock_guard lock(mutex_);
+        reason = reason_;
+        if (reason == Reason::None) {
+            // Targets of finished queries are dropped as new ones come in.
+            std::erase_if(targets_, [](const auto& existing) { return existing.expired(); });
+            targets_.push_back(target);
+        }
+    }
+    if (reason != Reason::None) {
+        target -> Cancel(reason);
+    }
+}
+
+auto QueryCanceller::Unschedule() noexcept -> void {
+    uint64_t id = 0;
+    {
+        const std::lock_guard lock(mutex_);
+        id = std::exchange(deadline_id_, 0);
+    }
+    if (id != 0) {
+        GetDeadlineWatchdog().Unschedule(id);
+    }
+}
+
+auto CancelAtDeadline(const std::shared_ptr<QueryCanceller>& canceller,
+                      std::chrono::steady_clock::time_point deadline) -> void {
+    const auto id = GetDeadlineWatchdog().Schedule(canceller, deadline);
+
+    const std::lock_guard lock(canceller -> mutex_);
+    canceller -> deadline_id_ = id;
+}
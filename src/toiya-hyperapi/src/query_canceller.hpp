@@ -0,0 +1,65 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+#include <hyperapi/hyperapi.hpp>
+
+// Cancels the query running on a connection from any thread. It is shared between
+// the stream and everyone who may cancel it, so a cancel that arrives after the
+// stream has been released does nothing.
+class QueryCanceller {
+public:
+    enum class Reason { None, Cancelled, DeadlineExceeded };
+
+    explicit QueryCanceller(hyperapi::Connection* connection) : connection_(connection) {}
+    QueryCanceller(const QueryCanceller&) = delete;
+    QueryCanceller &operator=(const QueryCanceller&) = delete;
+    ~QueryCanceller();
+
+    // Only the first reason is kept.
+    auto Cancel(Reason reason = Reason::Cancelled) noexcept -> void;
+    auto GetReason() const noexcept -> Reason;
+    // Called once the stream no longer uses the connection. Also drops a pending
+    // deadline.
+    auto Detach() noexcept -> void;
+    // Cancel also cancels target with the same reason, right away when it has
+    // happened already. Lets a stream that runs several queries in turn hand out a
+    // single canceller for all of them.
+    auto Forward(const std::shared_ptr<QueryCanceller>& target) -> void;
+
+private:
+    friend auto CancelAtDeadline(const std::shared_ptr<QueryCanceller>& canceller,
+                                 std::chrono::steady_clock::time_point deadline) -> void;
+
+    auto Unschedule() noexcept -> void;
+
+    mutable std::mutex mutex_;
+    hyperapi::Connection* connection_;
+    Reason reason_ = Reason::None;
+    // Entry of the pending deadline, see CancelAtDeadline. 0 when there is none.
+    uint64_t deadline_id_ = 0;
+    std::vector<std::weak_ptr<QueryCanceller>> targets_;
+};
+
+class QueryCancelledError : public std::runtime_error {
+public:
+    explicit QueryCancelledError(QueryCanceller::Reason reason)
+        : std::runtime_error(reason == QueryCanceller::Reason::DeadlineExceeded
+                                 ? "query deadline exceeded" : "query was cancelled"),
+          reason_(reason) {}
+
+    auto GetReason() const { return reason_; }
+
+private:
+    QueryCanceller::Reason reason_;
+};
+
+// Cancels with Reason::DeadlineExceeded once deadline has passed, unless every
+// owner has released the canceller by then.
+auto CancelAtDeadline(const std::shared_ptr<QueryCanceller>& canceller,
+                      std::chrono::steady_clock::time_point deadline) -> void;
@@ -1,6 +1,16 @@
 #include "reader_sample.hpp"
-
+#include "buffer_pool.hpp"
+#include "column_statistics.hpp"
+#include "hyper_session.hpp"
+#include "query_canceller.hpp"
+#include "result_cache.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <limits>
+#include <optional>
 #include <span>
+#include <unordered_set>
 #include <variant>
 #include <vector>
 
@@ -14,118 +24,119 @@ namespace gsl {
 
 class ReadHelper {
 public:
-    explicit ReadHelper(struct ArrowArray* array) : array_(array) {}
+    explicit ReadHelper(struct ArrowArray* array, bool nullable) : array_(array), nullable_(nullable) {}
     ReadHelper(const ReadHelper&) = delete;
     ReadHelper &operator=(ReadHelper &) = delete;
     ReadHelper(ReadHelper &&) = delete;
     ReadHelper &operator=(ReadHelper &&) = delete;
 
     virtual ~ReadHelper() = default;
-    virtual auto Read(const hyperapi::Value &) -> void = 0;
+
+    // Values read from now on are also added to statistics.
+    auto CollectStatistics(ColumnStatistics* statistics) -> void { statistics_ = statistics; }
+
+    auto Read(const hyperapi::Value& value) -> void {
+        // NOT NULL columns skip the check, so their validity bitmap is never allocated.
+        if (nullable_ && value.isNull()) {
+            if (ArrowArrayAppendNull(GetMutableArray(), 1)) {
+                throw std::runtime_error("ArrowAppendNull failed");
+            }
+            if (statistics_) {
+                statistics_ -> AddNull();
+            }
+            return;
+        }
+        ReadValue(value);
+    }
 
 protected:
-    auto GetMutableArray() { return array_; }
+    virtual auto ReadValue(const hyperapi::Value &) -> void = 0;
+    auto GetMutableArray() -> struct ArrowArray* { return array_; }
+    auto GetStatistics() -> ColumnStatistics* { return statistics_; }
 
 private:
     struct ArrowArray* array_;
+    bool nullable_;
+    ColumnStatistics* statistics_ = nullptr;
 };
 
 
 template <typename T> class IntegralReadHelper : public ReadHelper {
     using ReadHelper::ReadHelper;
 
-    auto Read(const hyperapi::Value& value) -> void override {
-        if (value.isNull()) {
-            if (ArrowArrayAppendNull(GetMutableArray(), 1)) {
-                throw std::runtime_error("ArrowAppendNull failed");
-            }
-            return;
-        }
-        if (ArrowArrayAppendInt(GetMutableArray(), value.get<T>())) {
+    auto ReadValue(const hyperapi::Value& value) -> void override {
+        const auto int_value = value.get<T>();
+        if (ArrowArrayAppendInt(GetMutableArray(), int_value)) {
             throw std::runtime_error("ArrowAppendInt failed");
         }
+        if (auto statistics = GetStatistics()) {
+            statistics -> AddInt(int_value);
+        }
     }
 };
 
 class OidReadHelper : public ReadHelper {
     using ReadHelper::ReadHelper;
 
-    auto Read(const hyperapi::Value& value) -> void override {
-        if (value.isNull()) {
-            if (ArrowArrayAppendNull(GetMutableArray(), 1)) {
-                throw std::runtime_error("ArrowAppendNull failed");
-            }
-            return;
-        }
-        if (ArrowArrayAppendUInt(GetMutableArray(), value.get<uint32_t>())) {
+    auto ReadValue(const hyperapi::Value& value) -> void override {
+        const auto oid = value.get<uint32_t>();
+        if (ArrowArrayAppendUInt(GetMutableArray(), oid)) {
             throw std::runtime_error("ArrowAppendUInt failed");
         }
+        if (auto statistics = GetStatistics()) {
+            statistics -> AddInt(oid);
+        }
     }
 };
 
 template <typename T> class FloatReaderHelper : public ReadHelper {
     using ReadHelper::ReadHelper;
 
-    auto Read(const hyperapi::Value& value) -> void override {
-        if (value.isNull()) {
-            if (ArrowArrayAppendNull(GetMutableArray(), 1)) {
-                throw std::runtime_error("ArrowAppendNull failed");
-            }
-            return;
-        }
-        if (ArrowArrayAppendDouble(GetMutableArray(), value.get<T>())) {
+    auto ReadValue(const hyperapi::Value& value) -> void override {
+        const auto float_value = value.get<T>();
+        if (ArrowArrayAppendDouble(GetMutableArray(), float_value)) {
             throw std::runtime_error("ArrowAppendDouble failed");
         }
+        if (auto statistics = GetStatistics()) {
+            statistics -> AddDouble(float_value);
+        }
     }
 };
 
 class BooleanReaderHelper : public ReadHelper {
     using ReadHelper::ReadHelper;
 
-    auto Read(const hyperapi::Value& value) -> void override {
-        if (value.isNull()) {
-            if (ArrowArrayAppendNull(GetMutableArray(), 1)) {
-                throw std::runtime_error("ArrowAppendNull failed");
-            }
-            return;
-        }
-        if (ArrowArrayAppendInt(GetMutableArray(), value.get<bool>())) {
+    auto ReadValue(const hyperapi::Value& value) -> void override {
+        const auto bool_value = value.get<bool>();
+        if (ArrowArrayAppendInt(GetMutableArray(), bool_value)) {
             throw std::runtime_error("ArrowAppendBool failed");
         }
+        if (auto statistics = GetStatistics()) {
+            statistics -> AddInt(bool_value);
+        }
     }
 };
 
 class BytesReaderHelper : public ReadHelper {
     using ReadHelper::ReadHelper;
 
-    auto Read(const hyperapi::Value& value) -> void override {
-        if (value.isNull()) {
-            if (ArrowArrayAppendNull(GetMutableArray(), 1)) {
-                throw std::runtime_error("ArrowAppendNull failed");
-            }
-            return;
-        }
-
+    auto ReadValue(const hyperapi::Value& value) -> void override {
         const auto bytes = value.get<hyperapi::ByteSpan>();
 
         if (ArrowArrayAppendBytes(GetMutableArray(),
                                   {{bytes.data}, static_cast<int64_t>(bytes.size)})) {
             throw std::runtime_error("ArrowAppendBytes failed");
         }
+        if (auto statistics = GetStatistics()) {
+            statistics -> AddBytes({reinterpret_cast<const char*>(bytes.data), bytes.size});
+        }
     }
 };
 
 class StringReaderHelper : public ReadHelper {
     using ReadHelper::ReadHelper;
 
-    auto Read(const hyperapi::Value& value) -> void override {
-        if (value.isNull()) {
-            if (ArrowArrayAppendNull(GetMutableArray(), 1)) {
-                throw std::runtime_error("ArrowAppendNull failed");
-            }
-            return;
-        }
-
+    auto ReadValue(const hyperapi::Value& value) -> void override {
 #if defined(_WIN32) && defined(_MSC_VER)
         const auto strval = value.get<std::string>();
         const ArrowStringView arrow_string_view{strval.c_str(), static_cast<int64_t>(strval.size())};
@@ -136,20 +147,16 @@ class StringReaderHelper : public ReadHelper {
         if (ArrowArrayAppendString(GetMutableArray(), arrow_string_view)) {
             throw std::runtime_error("ArrowAppendString failed");
         }
+        if (auto statistics = GetStatistics()) {
+            statistics -> AddBytes({arrow_string_view.data, static_cast<size_t>(arrow_string_view.size_bytes)});
+        }
     }
 };
 
 class DateReaderHelper : public ReadHelper {
     using ReadHelper::ReadHelper;
 
-    auto Read(const hyperapi::Value& value) -> void override {
-        if (value.isNull()) {
-            if (ArrowArrayAppendNull(GetMutableArray(), 1)) {
-                throw std::runtime_error("ArrowAppendNull failed");
-            }
-            return;
-        }
-
+    auto ReadValue(const hyperapi::Value& value) -> void override {
         // getRaw returns the Julian calendar so to convert it to Unix Date, the tableau_to_unix_days
         // has julian day of the unix day. (BC 4713/1/1 as 0 to AC 1970/1/1, 2440588)
         constexpr int32_t tableau_to_unix_days = 2440588;
@@ -170,25 +177,23 @@ class DateReaderHelper : public ReadHelper {
             throw std::runtime_error("Failed to append date32 value");
         }
 
+        // Like nanoarrow's own appenders, only extend the bitmap once a null has created it.
         struct ArrowBitmap* validity_bitmap = ArrowArrayValidityBitmap(array);
-        if (ArrowBitmapAppend(validity_bitmap, true, 1)) {
+        if (validity_bitmap -> buffer.data != nullptr && ArrowBitmapAppend(validity_bitmap, true, 1)) {
             throw std::runtime_error("Could not append validity buffer for date32");
         }
         array -> length++;
+
+        if (auto statistics = GetStatistics()) {
+            statistics -> AddInt(arrow_value);
+        }
     }
 };
 
 template <bool TZAware> class DateTimeReaderHelper : public ReadHelper {
     using ReadHelper::ReadHelper;
 
-    auto Read(const hyperapi::Value& value) -> void override {
-        if (value.isNull()) {
-            if (ArrowArrayAppendNull(GetMutableArray(), 1)) {
-                throw std::runtime_error("ArrowAppendNull failed");
-            }
-            return;
-        }
-
+    auto ReadValue(const hyperapi::Value& value) -> void override {
         using timestamp_t = typename std::conditional<TZAware, hyperapi::OffsetTimestamp, hyperapi::Timestamp>::type;
         const auto hyper_ts = value.get<timestamp_t>();
 
@@ -204,44 +209,38 @@ template <bool TZAware> class DateTimeReaderHelper : public ReadHelper {
             throw std::runtime_error("Failed to append timestamp64 value");
         }
 
+        // Like nanoarrow's own appenders, only extend the bitmap once a null has created it.
         struct ArrowBitmap* validity_bitmap = ArrowArrayValidityBitmap(array);
-        if (ArrowBitmapAppend(validity_bitmap, true, 1)) {
+        if (validity_bitmap -> buffer.data != nullptr && ArrowBitmapAppend(validity_bitmap, true, 1)) {
             throw std::runtime_error("Could not append validity buffer for timestamp");
         }
         array -> length++;
+
+        if (auto statistics = GetStatistics()) {
+            statistics -> AddInt(arrow_value);
+        }
     }
 };
 
 class TimeReaderHelper : public ReadHelper {
     using ReadHelper::ReadHelper;
 
-    auto Read(const hyperapi::Value& value) -> void override {
-        if (value.isNull()) {
-            if (ArrowArrayAppendNull(GetMutableArray(), 1)) {
-                throw std::runtime_error("ArrowAppendNull failed");
-            }
-            return;
-        }
-
+    auto ReadValue(const hyperapi::Value& value) -> void override {
         const auto time = value.get<hyperapi::Time>();
         const auto raw_value = time.getRaw();
         if (ArrowArrayAppendInt(GetMutableArray(), static_cast<int64_t>(raw_value))) {
             throw std::runtime_error("ArrowAppendInt failed");
         }
+        if (auto statistics = GetStatistics()) {
+            statistics -> AddInt(static_cast<int64_t>(raw_value));
+        }
     }
 };
 
 class IntervalReaderHelper : public ReadHelper {
     using ReadHelper::ReadHelper;
 
-    auto Read(const hyperapi::Value& value) -> void override {
-        if (value.isNull()) {
-            if (ArrowArrayAppendNull(GetMutableArray(), 1)) {
-                throw std::runtime_error("ArrowAppendNull failed");
-            }
-            return;
-        }
-
+    auto ReadValue(const hyperapi::Value& value) -> void override {
         struct ArrowInterval arrow_interval = {};
         ArrowIntervalInit(&arrow_interval, NANOARROW_TYPE_INTERVAL_MONTH_DAY_NANO);
         const auto interval_value = value.get<hyperapi::Interval>();
@@ -262,22 +261,21 @@ class IntervalReaderHelper : public ReadHelper {
         if (ArrowArrayAppendInterval(GetMutableArray(), &arrow_interval)) {
             throw std::runtime_error("ArrowAppendInterval failed");
         }
+        if (auto statistics = GetStatistics()) {
+            statistics -> AddUnordered(ColumnStatistics::Mix(
+                static_cast<uint64_t>(arrow_interval.ns) ^
+                ColumnStatistics::Mix((static_cast<uint64_t>(static_cast<uint32_t>(arrow_interval.months)) << 32) |
+                                      static_cast<uint32_t>(arrow_interval.days))));
+        }
     }
 };
 
 class DecimalReaderHelper : public ReadHelper {
 public:
-    explicit DecimalReaderHelper(struct ArrowArray* array, int32_t precision, int32_t scale)
-        : ReadHelper(array), precision_(precision), scale_(scale) {}
-
-    auto Read(const hyperapi::Value& value) -> void override {
-        if (value.isNull()) {
-            if (ArrowArrayAppendNull(GetMutableArray(), 1)) {
-                throw std::runtime_error("ArrowAppendNull failed");
-            }
-            return;
-        }
+    explicit DecimalReaderHelper(struct ArrowArray* array, bool nullable, int32_t precision, int32_t scale)
+        : ReadHelper(array, nullable), precision_(precision), scale_(scale) {}
 
+    auto ReadValue(const hyperapi::Value& value) -> void override {
         constexpr int32_t bitwidth = 128;
         struct ArrowDecimal decimal = {};
         ArrowDecimalInit(&decimal, bitwidth, precision_, scale_);
@@ -314,6 +312,9 @@ public:
         if (ArrowArrayAppendDecimal(GetMutableArray(), &decimal)) {
             throw std::runtime_error("Failed to append decimal value");
         }
+        if (auto statistics = GetStatistics()) {
+            statistics -> AddUnordered(ColumnStatistics::Hash(decimal_string));
+        }
     }
 
 private:
@@ -322,44 +323,45 @@ private:
 };
 
 static auto MakeReadHelper(const ArrowSchemaView* schema_view,
-                           struct ArrowArray* array) -> std::unique_ptr<ReadHelper> {
+                           struct ArrowArray* array,
+                           bool nullable) -> std::unique_ptr<ReadHelper> {
     switch (schema_view -> type) {
         case NANOARROW_TYPE_INT16:
-            return std::unique_ptr<ReadHelper>(new IntegralReadHelper<int16_t>(array));
+            return std::unique_ptr<ReadHelper>(new IntegralReadHelper<int16_t>(array, nullable));
         case NANOARROW_TYPE_INT32:
-            return std::unique_ptr<ReadHelper>(new IntegralReadHelper<int32_t>(array));
+            return std::unique_ptr<ReadHelper>(new IntegralReadHelper<int32_t>(array, nullable));
         case NANOARROW_TYPE_INT64:
-            return std::unique_ptr<ReadHelper>(new IntegralReadHelper<int64_t>(array));
+            return std::unique_ptr<ReadHelper>(new IntegralReadHelper<int64_t>(array, nullable));
         case NANOARROW_TYPE_UINT32:
-            return std::unique_ptr<ReadHelper>(new OidReadHelper(array));
+            return std::unique_ptr<ReadHelper>(new OidReadHelper(array, nullable));
         case NANOARROW_TYPE_FLOAT:
-            return std::unique_ptr<ReadHelper>(new FloatReaderHelper<float>(array));
+            return std::unique_ptr<ReadHelper>(new FloatReaderHelper<float>(array, nullable));
         case NANOARROW_TYPE_DOUBLE:
-            return std::unique_ptr<ReadHelper>(new FloatReaderHelper<double>(array));
+            return std::unique_ptr<ReadHelper>(new FloatReaderHelper<double>(array, nullable));
         case NANOARROW_TYPE_LARGE_BINARY:
-            return std::unique_ptr<ReadHelper>(new BytesReaderHelper(array));
+            return std::unique_ptr<ReadHelper>(new BytesReaderHelper(array, nullable));
         case NANOARROW_TYPE_LARGE_STRING:
-            return std::unique_ptr<ReadHelper>(new StringReaderHelper(array));
+            return std::unique_ptr<ReadHelper>(new StringReaderHelper(array, nullable));
         case NANOARROW_TYPE_BOOL:
-            return std::unique_ptr<ReadHelper>(new BooleanReaderHelper(array));
+            return std::unique_ptr<ReadHelper>(new BooleanReaderHelper(array, nullable));
         case NANOARROW_TYPE_DATE32:
-            return std::unique_ptr<ReadHelper>(new DateReaderHelper(array));
+            return std::unique_ptr<ReadHelper>(new DateReaderHelper(array, nullable));
         case NANOARROW_TYPE_TIMESTAMP: {
             if (strcmp("", schema_view -> timezone) != 0) {
-                return std::unique_ptr<ReadHelper>(new DateTimeReaderHelper<true>(array));
+                return std::unique_ptr<ReadHelper>(new DateTimeReaderHelper<true>(array, nullable));
             } else {
-                return std::unique_ptr<ReadHelper>(new DateTimeReaderHelper<false>(array));
+                return std::unique_ptr<ReadHelper>(new DateTimeReaderHelper<false>(array, nullable));
             }
         }
         case NANOARROW_TYPE_INTERVAL_MONTH_DAY_NANO:
-            return std::unique_ptr<ReadHelper>(new IntervalReaderHelper(array));
+            return std::unique_ptr<ReadHelper>(new IntervalReaderHelper(array, nullable));
         case NANOARROW_TYPE_TIME64:
-            return std::unique_ptr<ReadHelper>(new TimeReaderHelper(array));
+            return std::unique_ptr<ReadHelper>(new TimeReaderHelper(array, nullable));
         case NANOARROW_TYPE_DECIMAL128: {
             const auto precision = schema_view -> decimal_precision;
             const auto scale = schema_view -> decimal_scale;
 
-            return std::unique_ptr<ReadHelper>(new DecimalReaderHelper(array, precision, scale));
+            return std::unique_ptr<ReadHelper>(new DecimalReaderHelper(array, nullable, precision, scale));
         }
         default:
             throw std::format_error("unknown arrow type provided");
@@ -421,13 +423,163 @@ static auto SetSchemaTypeFromHyperType(struct ArrowSchema* schema, const hyperap
     }
 }
 
+// Turns a byte target into a row target for the next batch. The row width starts
+// from a schema based guess and is corrected by the bytes actually observed, so wide
+// text columns shrink the batches and narrow tables grow them.
+class BatchSizer {
+public:
+    static constexpr size_t kInitialChunkRows = 8192;
+    static constexpr size_t kMaxChunkRows = 1 << 20;
+    static constexpr size_t kFirstCheckRows = 1024;
+
+    explicit BatchSizer(size_t target_bytes) : target_bytes_(target_bytes) {}
+
+    auto IsEnabled() const { return target_bytes_ != 0; }
+
+    // Only used until the first batch has been measured.
+    auto SetSchemaEstimate(size_t row_bytes) -> void {
+        if (!observed_) {
+            row_bytes_ = static_cast<double>(std::max<size_t>(row_bytes, 1));
+        }
+    }
+
+    auto RowTarget() const -> size_t {
+        const auto rows = static_cast<size_t>(static_cast<double>(target_bytes_) / row_bytes_);
+        return std::clamp<size_t>(rows, 1, kMaxChunkRows);
+    }
+
+    // Returns true once the batch has reached the byte target. Otherwise, projects
+    // the row count at which the target should be reached and stores it in next_check.
+    auto IsFull(size_t rows, size_t bytes, size_t* next_check) const -> bool {
+        if (bytes >= target_bytes_) {
+            return true;
+        }
+        const auto projected = bytes == 0
+            ? rows * 2
+            : static_cast<size_t>(static_cast<double>(rows) * static_cast<double>(target_bytes_) / static_cast<double>(bytes));
+        *next_check = std::max(rows + 1, projected);
+        return false;
+    }
+
+    auto Observe(size_t rows, size_t bytes) -> void {
+        if (rows == 0) {
+            return;
+        }
+        const auto row_bytes = std::max(static_cast<double>(bytes) / static_cast<double>(rows), 1.0);
+        // Blend with the previous estimate so that a single odd batch does not make
+        // the chunk size jump around.
+        row_bytes_ = observed_ ? (row_bytes_ + row_bytes) / 2 : row_bytes;
+        observed_ = true;
+    }
+
+    static auto EstimateRowBytes(const ArrowSchemaView* schema_view) -> size_t {
+        // Variable length values start with a guess and are measured afterwards.
+        constexpr size_t VarLengthGuess = 16;
+
+        switch (schema_view -> type) {
+            case NANOARROW_TYPE_BOOL: return 1;
+            case NANOARROW_TYPE_INT16: return 2;
+            case NANOARROW_TYPE_INT32: case NANOARROW_TYPE_UINT32: case NANOARROW_TYPE_FLOAT:
+            case NANOARROW_TYPE_DATE32: return 4;
+            case NANOARROW_TYPE_INT64: case NANOARROW_TYPE_DOUBLE: case NANOARROW_TYPE_TIMESTAMP:
+            case NANOARROW_TYPE_TIME64: return 8;
+            case NANOARROW_TYPE_INTERVAL_MONTH_DAY_NANO: case NANOARROW_TYPE_DECIMAL128: return 16;
+            case NANOARROW_TYPE_LARGE_STRING: case NANOARROW_TYPE_LARGE_BINARY:
+                return sizeof(int64_t) + VarLengthGuess;
+            default: return VarLengthGuess;
+        }
+    }
+
+    static auto MeasureBytes(struct ArrowArray* array) -> size_t {
+        size_t bytes = 0;
+        const std::span children{array -> children, static_cast<size_t>(array -> n_children)};
+        for (auto child : children) {
+            for (int64_t i = 0; i < child -> n_buffers; i++) {
+                bytes += static_cast<size_t>(ArrowArrayBuffer(child, i) -> size_bytes);
+            }
+        }
+        return bytes;
+    }
+
+private:
+    size_t target_bytes_;
+    double row_bytes_ = 1.0;
+    bool observed_ = false;
+};
+
+// Everything about the result columns that stays the same from batch to batch.
+struct DecoderPlan {
+    nanoarrow::UniqueSchema schema;
+    // Views into the children of schema.
+    std::vector<struct ArrowSchemaView> columns;
+    // False only for columns the caller declared NOT NULL.
+    std::vector<bool> check_nulls;
+    size_t row_bytes_estimate = 0;
+};
+
 struct HyperResultIteratorPrivate {
-    HyperResultIteratorPrivate(std::unique_ptr<hyperapi::Result> result,
-                               std::unique_ptr<hyperapi::ChunkedResultIterator> iter)
-                               : result_(std::move(result)), iter_(std::move(iter)) {}
+    HyperResultIteratorPrivate(PooledConnection connection,
+                               std::shared_ptr<QueryCanceller> canceller,
+                               std::unique_ptr<hyperapi::Result> result,
+                               std::unique_ptr<hyperapi::ChunkedResultIterator> iter,
+                               std::shared_ptr<BatchStatistics> statistics,
+                               const ReadOptions& options,
+                               std::unordered_map<std::string, hyperapi::SqlType> table_not_null_columns)
+                               : connection_(std::move(connection)), canceller_(std::move(canceller)),
+                                 statistics_(std::move(statistics)),
+                                 result_(std::move(result)),
+                                 iter_(std::move(iter)), sizer_(options.target_batch_bytes),
+                                 single_batch_(options.single_batch),
+                                 not_null_columns_(options.not_null_columns.begin(), options.not_null_columns.end()),
+                                 table_not_null_columns_(std::move(table_not_null_columns)) {
+        if (options.allocator != nullptr) {
+            allocator_ = MakeHostAllocator(options.allocator);
+        } else if (options.buffer_pool_bytes) {
+            pool_ = BufferPool::Create(options.buffer_pool_bytes);
+            allocator_ = pool_ -> Allocator();
+        }
+    }
+
+    HyperResultIteratorPrivate(const HyperResultIteratorPrivate&) = delete;
+    HyperResultIteratorPrivate &operator=(const HyperResultIteratorPrivate&) = delete;
+
+    ~HyperResultIteratorPrivate() {
+        // Released before the end: stop Hyper from producing rows nobody reads.
+        const auto end = hyperapi::ChunkedResultIterator{*result_, hyperapi::IteratorEndTag{}};
+        if (row_ || !(*iter_ == end)) {
+            canceller_ -> Cancel();
+        }
 
+        row_.reset();
+        iter_.reset();
+        result_.reset();
+        canceller_ -> Detach();
+
+        // A cancel request may still be in flight and could hit the next query,
+        // so such connections are not pooled.
+        if (canceller_ -> GetReason() != QueryCanceller::Reason::None) {
+            connection_.Discard();
+        }
+    }
+
+    // The connection has to outlive the result, so it is declared first.
+    PooledConnection connection_;
+    std::shared_ptr<QueryCanceller> canceller_;
+    // Null unless statistics were requested.
+    std::shared_ptr<BatchStatistics> statistics_;
     std::unique_ptr<hyperapi::Result> result_;
     std::unique_ptr<hyperapi::ChunkedResultIterator> iter_;
+    // Set when the previous batch ended in the middle of the current chunk.
+    std::optional<hyperapi::ChunkIterator> row_;
+    BatchSizer sizer_;
+    bool single_batch_;
+    // Batches keep their own reference to the pool, so they may outlive the stream.
+    std::unique_ptr<BufferPool, BufferPool::Unref> pool_;
+    std::optional<struct ArrowBufferAllocator> allocator_;
+    std::unordered_set<std::string> not_null_columns_;
+    // NOT NULL columns of options.nullability_table with their types.
+    std::unordered_map<std::string, hyperapi::SqlType> table_not_null_columns_;
+    std::optional<DecoderPlan> plan_;
     struct ArrowError error_ {};
 };
 
@@ -440,16 +592,32 @@ static auto ReleaseArrowStream(void *ptr) noexcept -> void {
     delete stream;
 }
 
-static const auto GetSchema = [](struct ArrowArrayStream* stream, struct ArrowSchema* out) noexcept {
-    auto private_data = static_cast<HyperResultIteratorPrivate*>(stream -> private_data);
+auto stream_error_from_exception(struct ArrowError* error) noexcept -> int {
+    try {
+        throw;
+    } catch (const QueryCancelledError& e) {
+        ArrowErrorSetString(error, e.what());
+        return e.GetReason() == QueryCanceller::Reason::DeadlineExceeded ? ETIMEDOUT : ECANCELED;
+    } catch (const hyperapi::HyperException& e) {
+        ArrowErrorSetString(error, e.what());
+        return EIO;
+    } catch (const std::bad_alloc&) {
+        ArrowErrorSetString(error, "out of memory");
+        return ENOMEM;
+    } catch (const std::exception& e) {
+        ArrowErrorSetString(error, e.what());
+        return EINVAL;
+    }
+}
 
-    const auto resultSchema = private_data -> result_ -> getSchema();
+static auto MakeDecoderPlan(HyperResultIteratorPrivate* private_data) -> int {
+    const auto& resultSchema = private_data -> result_ -> getSchema();
 
-    nanoarrow::UniqueSchema schema{};
-    ArrowSchemaInit(schema.get());
+    DecoderPlan plan{};
+    ArrowSchemaInit(plan.schema.get());
 
     if (ArrowSchemaSetTypeStruct(
-        schema.get(), static_cast<int64_t>(resultSchema.getColumnCount()))) {
+        plan.schema.get(), static_cast<int64_t>(resultSchema.getColumnCount()))) {
         ArrowErrorSetString(&private_data -> error_, "ArrowSchemaSetTypeStruct failed");
 
         return EINVAL;
@@ -457,88 +625,189 @@ static const auto GetSchema = [](struct ArrowArrayStream* stream, struct ArrowSc
 
     const auto column_count = resultSchema.getColumnCount();
     std::unordered_map<std::string, size_t> name_counter;
-    const std::span children = {schema -> children, static_cast<size_t>(schema -> n_children)};
+    const std::span children = {plan.schema -> children, static_cast<size_t>(plan.schema -> n_children)};
+    plan.columns.resize(column_count);
+    plan.check_nulls.resize(column_count);
+
+    std::unordered_map<std::string, size_t> occurrences;
+    for (size_t i = 0; i < column_count; i++) {
+        occurrences[resultSchema.getColumn(i).getName().getUnescaped()]++;
+    }
 
     for (size_t i = 0; i < column_count; i++) {
         const auto& column = resultSchema.getColumn(i);
-        auto name = column.getName().getUnescaped();
+        const auto hyper_name = column.getName().getUnescaped();
+        auto name = hyper_name;
         const auto& [elem, did_insert] = name_counter.emplace(name, 0);
-
         if (!did_insert) {
             name += "_" + std::to_string(elem -> second);
         }
         elem -> second++;
 
+        // The caller's hints name columns as emitted, so each applies to one column.
+        const bool declared = private_data -> not_null_columns_.contains(name);
+        // The result does not tell which table a column comes from, so a table's
+        // declaration is only taken over by the one column of that name and type.
+        // Such columns keep checking for NULL: a computed column that just shares
+        // the name, e.g. the outer side of a LEFT JOIN, still decodes its NULLs.
+        const auto table_column = private_data -> table_not_null_columns_.find(hyper_name);
+        const bool from_table = table_column != private_data -> table_not_null_columns_.end() &&
+                                occurrences[hyper_name] == 1 && table_column -> second == column.getType();
+        plan.check_nulls[i] = !declared;
+
         if (ArrowSchemaSetName(children[i], name.c_str())) {
             ArrowErrorSetString(&private_data -> error_, "ArrowSchemaSetName failed");
             return EINVAL;
         }
 
         SetSchemaTypeFromHyperType(children[i], column.getType());
+        if (declared || from_table) {
+            children[i] -> flags &= ~ARROW_FLAG_NULLABLE;
+        }
+
+        if (ArrowSchemaViewInit(&plan.columns[i], children[i], nullptr)) {
+            ArrowErrorSetString(&private_data -> error_, "ArrowSchemaViewInit failed");
+            return EINVAL;
+        }
+        plan.row_bytes_estimate += BatchSizer::EstimateRowBytes(&plan.columns[i]);
     }
 
-    ArrowSchemaMove(schema.get(), out);
+    private_data -> plan_ = std::move(plan);
 
     return 0;
-};
+}
 
-static const auto GetNext = [](struct ArrowArrayStream* stream, struct ArrowArray* out) noexcept {
+static const auto GetSchema = [](struct ArrowArrayStream* stream, struct ArrowSchema* out) noexcept {
     auto private_data = static_cast<HyperResultIteratorPrivate*>(stream -> private_data);
 
+    if (!private_data -> plan_) {
+        try {
+            if (int errcode = MakeDecoderPlan(private_data)) {
+                return errcode;
+            }
+        } catch (...) {
+            return stream_error_from_exception(&private_data -> error_);
+        }
+    }
+
+    if (ArrowSchemaDeepCopy(private_data -> plan_ -> schema.get(), out)) {
+        ArrowErrorSetString(&private_data -> error_, "ArrowSchemaDeepCopy failed");
+        return ENOMEM;
+    }
+
+    return 0;
+};
+
+static auto ReadNextBatch(HyperResultIteratorPrivate* private_data, struct ArrowArray* out) -> int {
+    if (const auto reason = private_data -> canceller_ -> GetReason(); reason != QueryCanceller::Reason::None) {
+        throw QueryCancelledError(reason);
+    }
+
     auto end = hyperapi::ChunkedResultIterator{*private_data -> result_, hyperapi::IteratorEndTag{}};
 
-    if (*private_data -> iter_ == end) {
+    if (!private_data -> row_ && *private_data -> iter_ == end) {
+        if (private_data -> statistics_) {
+            private_data -> statistics_ -> columns.clear();
+        }
+        out -> release = nullptr;
         return 0;
     }
 
-    nanoarrow::UniqueSchema schema{};
-    if (int errcode = GetSchema(stream, schema.get())) {
-        return errcode;
+    if (!private_data -> plan_) {
+        if (int errcode = MakeDecoderPlan(private_data)) {
+            return errcode;
+        }
     }
+    const auto& plan = *private_data -> plan_;
 
-    const auto column_count = static_cast<size_t>(schema -> n_children);
+    const auto column_count = plan.columns.size();
     nanoarrow::UniqueArray array{};
-    if (ArrowArrayInitFromSchema(array.get(), schema.get(), nullptr)) {
+    if (ArrowArrayInitFromSchema(array.get(), plan.schema.get(), nullptr)) {
         ArrowErrorSetString(&private_data -> error_, "ArrowArrayInitFromSchema failed");
         return EINVAL;
     }
 
+    if (private_data -> allocator_ && SetArrayAllocator(array.get(), *private_data -> allocator_)) {
+        ArrowErrorSetString(&private_data -> error_, "SetArrayAllocator failed");
+        return EINVAL;
+    }
+
     // TODO: we might want to move the vector of ReadHelpers to the private_data
     // rather than doing on each loop iteration here.
     std::vector<std::unique_ptr<ReadHelper>> read_helpers {column_count};
-    const std::span schema_children{schema -> children, static_cast<size_t>(schema -> n_children)};
     const std::span array_children{array -> children, static_cast<size_t>(array -> n_children)};
 
     for (size_t i = 0; i < column_count; i++) {
-        struct ArrowSchemaView schema_view {};
-        if (ArrowSchemaViewInit(&schema_view, schema_children[i], nullptr)) {
-            ArrowErrorSetString(&private_data -> error_, "ArrowSchemaViewInit failed");
-            return EINVAL;
-        }
-
-        auto read_helper = MakeReadHelper(&schema_view, array_children[i]);
+        auto read_helper = MakeReadHelper(&plan.columns[i], array_children[i], plan.check_nulls[i]);
         read_helpers[i] = std::move(read_helper);
     }
 
+    if (auto& statistics = private_data -> statistics_) {
+        statistics -> columns.resize(column_count);
+        for (size_t i = 0; i < column_count; i++) {
+            statistics -> columns[i].Clear();
+            read_helpers[i] -> CollectStatistics(&statistics -> columns[i]);
+        }
+    }
+
+    auto& sizer = private_data -> sizer_;
+    sizer.SetSchemaEstimate(plan.row_bytes_estimate);
+
     if (ArrowArrayStartAppending(array.get())) {
         ArrowErrorSetString(&private_data -> error_, "ArrowArrayStartAppending failed");
         return EINVAL;
     }
 
-    for (const auto& row : **private_data -> iter_) {
-        size_t column_idx = 0;
-        for (const auto& value : row) {
-            const auto &read_helper = read_helpers[column_idx];
-            read_helper->Read(value);
-            column_idx++;
+    // Without a byte target every Hyper chunk becomes exactly one batch, unless the
+    // whole result was asked for as a single batch. With a byte target,
+    // rows are taken across chunk boundaries until the batch is big enough, and a
+    // chunk that is too big is split, resuming from row_ on the next call.
+    size_t row_count = 0;
+    size_t next_check = sizer.IsEnabled()
+        ? std::min(sizer.RowTarget(), BatchSizer::kFirstCheckRows)
+        : std::numeric_limits<size_t>::max();
+    bool batch_full = false;
+
+    while (!batch_full && !(*private_data -> iter_ == end)) {
+        const auto& chunk = **private_data -> iter_;
+        if (!private_data -> row_) {
+            private_data -> row_.emplace(chunk, hyperapi::IteratorBeginTag{});
+        }
+        auto& row_iter = *private_data -> row_;
+        const hyperapi::ChunkIterator chunk_end{chunk, hyperapi::IteratorEndTag{}};
+
+        while (!batch_full && row_iter != chunk_end) {
+            size_t column_idx = 0;
+            for (const auto& value : *row_iter) {
+                const auto &read_helper = read_helpers[column_idx];
+                read_helper->Read(value);
+                column_idx++;
+            }
+
+            if (ArrowArrayFinishElement(array.get())) {
+                ArrowErrorSetString(&private_data -> error_, "ArrowArrayFinishElement failed");
+                return EINVAL;
+            }
+            ++row_iter;
+            ++row_count;
+
+            if (row_count >= next_check) {
+                batch_full = sizer.IsFull(row_count, BatchSizer::MeasureBytes(array.get()), &next_check);
+            }
         }
 
-        if (ArrowArrayFinishElement(array.get())) {
-            ArrowErrorSetString(&private_data -> error_, "ArrowArrayFinishElement failed");
-            return EINVAL;
+        if (row_iter == chunk_end) {
+            private_data -> row_.reset();
+            ++(*private_data->iter_);
+            batch_full = batch_full || (!sizer.IsEnabled() && !private_data -> single_batch_);
         }
     }
-    ++(*private_data->iter_);
+
+    if (sizer.IsEnabled()) {
+        // Only the batches adapt. The chunk size stays as set before the query ran,
+        // since nothing guarantees Hyper applies a change to a result in flight.
+        sizer.Observe(row_count, BatchSizer::MeasureBytes(array.get()));
+    }
 
     if (ArrowArrayFinishBuildingDefault(array.get(), nullptr)) {
         ArrowErrorSetString(&private_data -> error_, "ArrowArrayFinishBuildingDefault failed");
@@ -548,61 +817,191 @@ static const auto GetNext = [](struct ArrowArrayStream* stream, struct ArrowArra
     ArrowArrayMove(array.get(), out);
 
     return 0;
+}
+
+static const auto GetNext = [](struct ArrowArrayStream* stream, struct ArrowArray* out) noexcept {
+    auto private_data = static_cast<HyperResultIteratorPrivate*>(stream -> private_data);
+
+    try {
+        try {
+            return ReadNextBatch(private_data, out);
+        } catch (const hyperapi::HyperException&) {
+            // Hyper reports a cancelled query as a plain error.
+            if (const auto reason = private_data -> canceller_ -> GetReason(); reason != QueryCanceller::Reason::None) {
+                throw QueryCancelledError(reason);
+            }
+            throw;
+        }
+    } catch (...) {
+        return stream_error_from_exception(&private_data -> error_);
+    }
 };
 
 auto read_from_hyper_query(const std::string& path,
                            const std::string& query,
                            size_t chunk_size)-> Result {
-    std::unordered_map<std::string, std::string> process_params = {};
+    ReadOptions options{};
+    options.chunk_size = chunk_size;
 
-    if (!process_params.count("log_config")) {
-        process_params["log_config"] = "";
-    } else {
-        process_params.erase("log_config");
+    return read_from_hyper_query(path, query, options);
+}
+
+auto read_from_hyper_connection(PooledConnection connection,
+                                const std::string& query,
+                                const ReadOptions& options)-> Result {
+    // Everything before the deadline is armed may throw and return the connection to
+    // the pool as it is; from then on a cancel may be in flight, which only the
+    // query's failure path below handles.
+    std::unordered_map<std::string, hyperapi::SqlType> table_not_null_columns;
+    if (!options.nullability_table.empty()) {
+        const auto table_definition =
+            connection -> getCatalog().getTableDefinition(ParseTableName(options.nullability_table));
+        for (const auto& column : table_definition.getColumns()) {
+            if (column.getNullability() == hyperapi::Nullability::NotNullable) {
+                table_not_null_columns.emplace(column.getName().getUnescaped(), column.getType());
+            }
+        }
     }
 
-    if (!process_params.count("default_database_version"))
-        process_params["default_database_version"] = "2";
+    auto effective_options = options;
+    if (options.target_batch_bytes && !options.chunk_size) {
+        effective_options.chunk_size = BatchSizer::kInitialChunkRows;
+    }
 
-    {
-        static const hyperapi::HyperProcess hyper{
-            hyperapi::Telemetry::DoNotSendUsageDataToTableau,
-            "",
-            process_params};
+    // Pooled connections keep the mode of their previous user, so always set it.
+    hyper_set_chunked_mode(hyperapi::internal::getHandle(*connection), effective_options.chunk_size != 0);
+    if (const auto chunk_size = effective_options.chunk_size) {
+        hyper_set_chunk_size(hyperapi::internal::getHandle(*connection), chunk_size);
+    }
 
-        {
-            hyperapi::Connection connection(hyper.getEndpoint(), path);
+    auto statistics = options.compute_statistics ? std::make_shared<BatchStatistics>() : nullptr;
+    auto canceller = std::make_shared<QueryCanceller>(&*connection);
+    if (options.timeout.count() > 0) {
+        CancelAtDeadline(canceller, std::chrono::steady_clock::now() + options.timeout);
+    }
 
-            if (chunk_size) {
-                hyper_set_chunked_mode(hyperapi::internal::getHandle(connection), true);
-                hyper_set_chunk_size(hyperapi::internal::getHandle(connection), chunk_size);
-            }
+    std::unique_ptr<hyperapi::Result> hyperResult;
+    std::unique_ptr<hyperapi::ChunkedResultIterator> iter;
+    try {
+        hyperResult = std::make_unique<hyperapi::Result>(connection -> executeQuery(query));
+        iter = std::make_unique<hyperapi::ChunkedResultIterator>(*hyperResult, hyperapi::IteratorBeginTag{});
+    } catch (const hyperapi::HyperException&) {
+        iter.reset();
+        hyperResult.reset();
+        canceller -> Detach();
+        if (const auto reason = canceller -> GetReason(); reason != QueryCanceller::Reason::None) {
+            connection.Discard();
+            throw QueryCancelledError(reason);
+        }
+        throw;
+    }
 
-            auto hyperResult = std::make_unique<hyperapi::Result>(connection.executeQuery(query));
+    auto private_data = gsl::owner<HyperResultIteratorPrivate*>(
+        new HyperResultIteratorPrivate{std::move(connection), canceller, std::move(hyperResult),
+                                       std::move(iter), statistics, effective_options,
+                                       std::move(table_not_null_columns)});
+
+    auto stream = gsl::owner<struct ArrowArrayStream*>(new struct ArrowArrayStream);
+    stream -> private_data = private_data;
+    stream -> get_next = GetNext;
+    stream -> get_schema = GetSchema;
+    stream -> get_last_error = [](struct ArrowArrayStream* stream) {
+        auto private_data = static_cast<HyperResultIteratorPrivate*>(stream->private_data);
+        return static_cast<const char*>(private_data -> error_.message);
+    };
+
+    stream -> release = [](struct ArrowArrayStream* stream) {
+        auto private_data = static_cast<gsl::owner<HyperResultIteratorPrivate*>>(
+            stream -> private_data);
+        delete private_data;
+        stream -> release = nullptr;
+    };
+
+    Result result{stream, "arrow_array_stream", &ReleaseArrowStream, std::move(canceller), std::move(statistics)};
+    return result;
+}
 
-            auto iter = std::make_unique<hyperapi::ChunkedResultIterator>(*hyperResult, hyperapi::IteratorBeginTag{});
+auto read_single_batch(PooledConnection connection,
+                       const std::string& query,
+                       const ReadOptions& options,
+                       struct ArrowSchema* schema,
+                       struct ArrowArray* array,
+                       const std::shared_ptr<QueryCanceller>& cancelled_by)-> void {
+    if (cancelled_by) {
+        if (const auto reason = cancelled_by -> GetReason(); reason != QueryCanceller::Reason::None) {
+            throw QueryCancelledError(reason);
+        }
+    }
 
-            auto private_data = gsl::owner<HyperResultIteratorPrivate*>(
-                new HyperResultIteratorPrivate{std::move(hyperResult), std::move(iter)});
+    auto single_batch_options = options;
+    single_batch_options.single_batch = true;
+    single_batch_options.chunk_size = 0;
+    single_batch_options.target_batch_bytes = 0;
 
-            auto stream = gsl::owner<struct ArrowArrayStream*>(new struct ArrowArrayStream);
-            stream -> private_data = private_data;
-            stream -> get_next = GetNext;
-            stream -> get_schema = GetSchema;
-            stream -> get_last_error = [](struct ArrowArrayStream* stream) {
-                auto private_data = static_cast<HyperResultIteratorPrivate*>(stream->private_data);
-                return static_cast<const char*>(private_data -> error_.message);
-            };
+    auto result = read_from_hyper_connection(std::move(connection), query, single_batch_options);
+    auto stream = static_cast<struct ArrowArrayStream*>(const_cast<void*>(result.data));
+    if (cancelled_by) {
+        try {
+            cancelled_by -> Forward(result.canceller);
+        } catch (...) {
+            result.release(stream);
+            throw;
+        }
+    }
 
-            stream -> release = [](struct ArrowArrayStream* stream) {
-                auto private_data = static_cast<gsl::owner<HyperResultIteratorPrivate*>>(
-                    stream -> private_data);
-                delete private_data;
-                stream -> release = nullptr;
-            };
+    auto errcode = stream -> get_schema(stream, schema);
+    if (errcode == 0) {
+        errcode = stream -> get_next(stream, array);
+    }
+    const std::string message = errcode != 0 ? stream -> get_last_error(stream) : "";
+    result.release(stream);
 
-            Result result{stream, "arrow_array_stream", &ReleaseArrowStream};
-            return result;
-        }
+    if (errcode == ECANCELED || errcode == ETIMEDOUT) {
+        throw QueryCancelledError(errcode == ETIMEDOUT
+            ? QueryCanceller::Reason::DeadlineExceeded : QueryCanceller::Reason::Cancelled);
+    }
+    if (errcode != 0) {
+        throw std::runtime_error(message);
+    }
+}
+
+auto make_stream_result(struct ArrowArrayStream* stream)-> Result {
+    auto owned = gsl::owner<struct ArrowArrayStream*>(new struct ArrowArrayStream);
+    ArrowArrayStreamMove(stream, owned);
+    return Result{owned, "arrow_array_stream", &ReleaseArrowStream, nullptr};
+}
+
+static auto ExecuteHyperQuery(const std::string& path,
+                              const std::string& query,
+                              const ReadOptions& options)-> Result {
+    return read_from_hyper_connection(GetHyperSession(options.hyper_path).Acquire(path), query, options);
+}
+
+auto read_from_hyper_query(const std::string& path,
+                           const std::string& query,
+                           const ReadOptions& options)-> Result {
+    // Cached results carry no statistics, so reads that want them bypass the cache.
+    if (options.cache_dir.empty() || options.compute_statistics) {
+        return ExecuteHyperQuery(path, query, options);
+    }
+
+    const auto key = ResultCache::MakeKey(path, query, options);
+    if (!key) {
+        return ExecuteHyperQuery(path, query, options);
+    }
+
+    const ResultCache cache(options.cache_dir, options.cache_max_bytes);
+    struct ArrowArrayStream cached {};
+    if (cache.Open(*key, &cached)) {
+        return make_stream_result(&cached);
+    }
+
+    auto result = ExecuteHyperQuery(path, query, options);
+    try {
+        cache.Tee(*key, static_cast<struct ArrowArrayStream*>(const_cast<void*>(result.data)));
+    } catch (...) {
+        result.release(const_cast<void*>(result.data));
+        throw;
     }
+    return result;
 }
@@ -1,6 +1,8 @@
 #pragma once
 
+#include <chrono>
 #include <iostream>
+#include <memory>
 #include <fstream>
 #include <string>
 #include <array>
@@ -8,6 +10,9 @@
 #include <utility>
 #include <variant>
 #include <unordered_map>
+#include <vector>
+
+#include "toiya.h"
 
 template <std::size_t N> constexpr auto to_integral_variant(std::size_t  n) {
     return [&]<std::size_t... Is>(std::index_sequence<Is...>) {
@@ -19,45 +24,85 @@ template <std::size_t N> constexpr auto to_integral_variant(std::size_t  n) {
     }(std::make_index_sequence<N>());
 }
 
+class PooledConnection;
+class QueryCanceller;
+struct BatchStatistics;
+
 struct Result {
     const void* data{};
     const char* name{};
     void (*release)(void*) noexcept = nullptr;
+    // Cancels the query behind data from any thread, see QueryCanceller.
+    std::shared_ptr<QueryCanceller> canceller{};
+    // Statistics of the batch emitted last, when requested through ReadOptions.
+    std::shared_ptr<BatchStatistics> statistics{};
+};
+
+struct ReadOptions {
+    // Rows per Hyper chunk. 0 keeps Hyper's default chunking.
+    size_t chunk_size = 0;
+    // When non-zero, the Hyper chunk size is tuned while reading and chunks are
+    // coalesced or split so that every emitted batch lands near this many bytes.
+    size_t target_batch_bytes = 0;
+    // Emits the whole result as one batch. Meant for small results such as previews.
+    bool single_batch = false;
+    // Collects min/max, null count and a distinct estimate per column and batch while
+    // decoding, see Result::statistics.
+    bool compute_statistics = false;
+    // Bytes of released batch buffers the stream keeps for reuse. 0 disables pooling.
+    size_t buffer_pool_bytes = 64 << 20;
+    // Allocator used instead of the pool when set.
+    const toiya_buffer_allocator* allocator = nullptr;
+    // Result columns known to be NOT NULL, by their emitted name, i.e. with the suffix
+    // that duplicated names get. They are decoded without null checks and emitted
+    // with null_count = 0 and no validity buffer.
+    std::vector<std::string> not_null_columns;
+    // Table whose NOT NULL declarations mark result columns of the same name and type
+    // NOT NULL, unless several result columns have that name. Such columns are still
+    // checked for NULL. Parsed with ParseTableName.
+    std::string nullability_table;
+    // Directory containing hyperd. Only the first stream decides, see GetHyperSession.
+    std::string hyper_path;
+    // The query is cancelled when it has not been read to the end within this time,
+    // counted from the start of the query. 0 means no deadline.
+    std::chrono::milliseconds timeout{0};
+    // Directory of the on-disk result cache, see ResultCache. Empty disables it.
+    std::string cache_dir;
+    // Bytes of cached results kept in cache_dir before the least recently used go.
+    uint64_t cache_max_bytes = 1ULL << 30;
 };
 
 auto read_from_hyper_query(const std::string& path,
                            const std::string& query,
                            size_t chunk_size)-> Result;
 
-extern "C" {
-    typedef struct {
-        const void* data;
-        const char* name;
-        void (*release)(void*) noexcept;
-    } CResult;
-
-    CResult read_from_hyper_query_c(const char* path, const char* query, size_t chunk_size) {
-        std::ofstream log_file("/tmp/hyper_debug.log", std::ios_base::app);
-        try {
-            log_file << "Starting read_from_hyper_query_c" << std::endl;
-
-            std::string path_str(path);
-            std::string query_str(query);
-
-            log_file << "Path: " << path_str << std::endl;
-            log_file << "Query: " << query_str << std::endl;
-
-            Result result = read_from_hyper_query(path_str, query_str, chunk_size);
-            log_file << "Query executed successfully" << std::endl;
-
-            std::cout << "Finished read_from_hyper_query_c" << std::endl;
-            return {result.data, result.name, result.release};
-        } catch (const std::exception& e) {
-            log_file << "Caught exception: " << e.what() << std::endl;
-            return {nullptr, nullptr, nullptr};
-        } catch (...) {
-            log_file << "Caught unknown exception" << std::endl;
-            return {nullptr, nullptr, nullptr};
-        }
-    }
-}
+auto read_from_hyper_query(const std::string& path,
+                           const std::string& query,
+                           const ReadOptions& options)-> Result;
+
+// Runs query on a connection the caller has prepared, e.g. with temporary tables.
+// The returned stream owns the connection until it is released. The result cache
+// is not consulted.
+auto read_from_hyper_connection(PooledConnection connection,
+                                const std::string& query,
+                                const ReadOptions& options)-> Result;
+
+// Runs query on a borrowed connection and reads its whole result as one batch into
+// schema and array, leaving array released when the result is empty. The stream is
+// released before returning, which hands the connection back. Throws
+// QueryCancelledError when the query was cancelled or timed out, including through
+// cancelled_by when it is set.
+auto read_single_batch(PooledConnection connection,
+                       const std::string& query,
+                       const ReadOptions& options,
+                       struct ArrowSchema* schema,
+                       struct ArrowArray* array,
+                       const std::shared_ptr<QueryCanceller>& cancelled_by = nullptr)-> void;
+
+// Moves a stream that involves no query, e.g. one built in memory, into a Result.
+auto make_stream_result(struct ArrowArrayStream* stream)-> Result;
+
+// Reports the exception being handled through get_last_error instead of letting it
+// escape the C callbacks: stores its message in error and returns the errno code
+// that ArrowArrayStream callbacks use for it.
+auto stream_error_from_exception(struct ArrowError* error) noexcept -> int;
@@ -0,0 +1,367 @@
+#include "result_cache.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+#include <nanoarrow/nanoarrow.hpp>
+#include <nanoarrow/nanoarrow_ipc.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+    constexpr auto kEntryExtension = ".arrows";
+    constexpr auto kTempExtension = ".tmp";
+    // Entries still being written are newer than this, so older temporary files were
+    // left behind by a crashed process and are swept by Evict.
+    constexpr auto kStaleTempAge = std::chrono::hours(24);
+
+    // FNV-1a. Two differently seeded passes give a 128 bit file name.
+    auto Fnv1a(const std::string& data, uint64_t seed) -> uint64_t {
+        auto hash = seed;
+        for (const auto c : data) {
+            hash ^= static_cast<uint8_t>(c);
+            hash *= 0x100000001b3ULL;
+        }
+        return hash;
+    }
+
+    auto AppendField(std::string& key, const std::string& field) -> void {
+        key += std::to_string(field.size());
+        key += ':';
+        key += field;
+    }
+
+    auto Touch(const std::filesystem::path& path) -> void {
+        std::error_code ec;
+        std::filesystem::last_write_time(path, std::filesystem::file_time_type::clock::now(), ec);
+    }
+
+#ifndef _WIN32
+    // Maps the entry read-only; the mapping is released with the buffer.
+    auto LoadEntry(const std::filesystem::path& path, struct ArrowBuffer* out) -> bool {
+        const int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+
+        struct stat st {};
+        if (::fstat(fd, &st) != 0 || st.st_size == 0) {
+            ::close(fd);
+            return false;
+        }
+
+        void* data = ::mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (data == MAP_FAILED) {
+            return false;
+        }
+        ::madvise(data, static_cast<size_t>(st.st_size), MADV_SEQUENTIAL);
+
+        ArrowBufferInit(out);
+        out -> data = static_cast<uint8_t*>(data);
+        out -> size_bytes = st.st_size;
+        out -> capacity_bytes = st.st_size;
+        out -> allocator = ArrowBufferDeallocator(
+            [](struct ArrowBufferAllocator*, uint8_t* ptr, int64_t size) {
+                ::munmap(ptr, static_cast<size_t>(size));
+            },
+            nullptr);
+        return true;
+    }
+#else
+    auto LoadEntry(const std::filesystem::path& path, struct ArrowBuffer* out) -> bool {
+        std::error_code ec;
+        const auto size = std::filesystem::file_size(path, ec);
+        if (ec || size == 0) {
+            return false;
+        }
+
+        const auto file = _wfopen(path.c_str(), L"rb");
+        if (file == nullptr) {
+            return false;
+        }
+
+        ArrowBufferInit(out);
+        const bool ok = ArrowBufferReserve(out, static_cast<int64_t>(size)) == NANOARROW_OK &&
+                        std::fread(out -> data, 1, size, file) == size;
+        std::fclose(file);
+        if (!ok) {
+            ArrowBufferReset(out);
+            return false;
+        }
+        out -> size_bytes = static_cast<int64_t>(size);
+        return true;
+    }
+#endif
+
+    auto OpenForWrite(const std::filesystem::path& path) -> FILE* {
+#ifdef _WIN32
+        return _wfopen(path.c_str(), L"wb");
+#else
+        return std::fopen(path.c_str(), "wb");
+#endif
+    }
+}
+
+struct CacheWriterPrivate {
+    CacheWriterPrivate() = default;
+    CacheWriterPrivate(const CacheWriterPrivate&) = delete;
+    CacheWriterPrivate &operator=(const CacheWriterPrivate&) = delete;
+
+    ~CacheWriterPrivate() {
+        Abandon();
+    }
+
+    // Stops writing and removes the incomplete entry.
+    auto Abandon() noexcept -> void {
+        if (!writing_) {
+            return;
+        }
+        ArrowIpcWriterReset(&writer_);
+        writing_ = false;
+        std::error_code ec;
+        std::filesystem::remove(temp_path_, ec);
+    }
+
+    auto Write(const struct ArrowArray* array) noexcept -> void {
+        if (!writing_) {
+            return;
+        }
+        struct ArrowError error {};
+        if (ArrowArrayViewSetArray(view_.get(), array, &error) != NANOARROW_OK ||
+            ArrowIpcWriterWriteArrayView(&writer_, view_.get(), &error) != NANOARROW_OK) {
+            Abandon();
+        }
+    }
+
+    auto Publish() noexcept -> void {
+        if (!writing_) {
+            return;
+        }
+        struct ArrowError error {};
+        const bool ok = ArrowIpcWriterWriteArrayView(&writer_, nullptr, &error) == NANOARROW_OK;
+        ArrowIpcWriterReset(&writer_);
+        writing_ = false;
+
+        std::error_code ec;
+        if (ok) {
+            std::filesystem::rename(temp_path_, entry_path_, ec);
+        }
+        if (!ok || ec) {
+            std::filesystem::remove(temp_path_, ec);
+            return;
+        }
+        cache_ -> Evict();
+    }
+
+    nanoarrow::UniqueArrayStream source_;
+    std::optional<ResultCache> cache_;
+    nanoarrow::UniqueArrayView view_;
+    struct ArrowIpcWriter writer_ {};
+    std::filesystem::path temp_path_;
+    std::filesystem::path entry_path_;
+    bool writing_ = false;
+};
+
+auto ResultCache::MakeKey(const std::string& path,
+                          const std::string& query,
+                          const ReadOptions& options) -> std::optional<std::string> {
+    std::error_code ec;
+    const auto canonical = std::filesystem::canonical(path, ec);
+    if (ec) {
+        return std::nullopt;
+    }
+    const auto size = std::filesystem::file_size(canonical, ec);
+    if (ec) {
+        return std::nullopt;
+    }
+    const auto mtime = std::filesystem::last_write_time(canonical, ec);
+    if (ec) {
+        return std::nullopt;
+    }
+
+    auto not_null_columns = options.not_null_columns;
+    std::sort(not_null_columns.begin(), not_null_columns.end());
+
+    std::string key;
+    AppendField(key, canonical.string());
+    AppendField(key, std::to_string(mtime.time_since_epoch().count()));
+    AppendField(key, std::to_string(size));
+    AppendField(key, query);
+    AppendField(key, std::to_string(options.chunk_size));
+    AppendField(key, std::to_string(options.target_batch_bytes));
+    AppendField(key, std::to_string(options.single_batch));
+    for (const auto& column : not_null_columns) {
+        AppendField(key, column);
+    }
+    AppendField(key, options.nullability_table);
+
+    char name[33];
+    std::snprintf(name, sizeof(name), "%016llx%016llx",
+                  static_cast<unsigned long long>(Fnv1a(key, 0xcbf29ce484222325ULL)),
+                  static_cast<unsigned long long>(Fnv1a(key, 0x84222325cbf29ce4ULL)));
+    return std::string(name);
+}
+
+auto ResultCache::EntryPath(const std::string& key) const -> std::filesystem::path {
+    return directory_ / (key + kEntryExtension);
+}
+
+auto ResultCache::Open(const std::string& key, struct ArrowArrayStream* out) const noexcept -> bool {
+    const auto path = EntryPath(key);
+
+    nanoarrow::UniqueBuffer buffer;
+    if (!LoadEntry(path, buffer.get())) {
+        return false;
+    }
+
+    struct ArrowIpcInputStream input {};
+    if (ArrowIpcInputStreamInitBuffer(&input, buffer.get()) != NANOARROW_OK) {
+        return false;
+    }
+    if (ArrowIpcArrayStreamReaderInit(out, &input, nullptr) != NANOARROW_OK) {
+        if (input.release != nullptr) {
+            input.release(&input);
+        }
+        return false;
+    }
+
+    // Reading the schema validates the header, so a damaged entry counts as a miss.
+    nanoarrow::UniqueSchema schema;
+    if (out -> get_schema(out, schema.get()) != 0) {
+        ArrowArrayStreamRelease(out);
+        std::error_code ec;
+        std::filesystem::remove(path, ec);
+        return false;
+    }
+
+    Touch(path);
+    return true;
+}
+
+auto ResultCache::Tee(const std::string& key, struct ArrowArrayStream* stream) const -> void {
+    static std::atomic<uint64_t> temp_counter{0};
+
+    auto private_data = std::make_unique<CacheWriterPrivate>();
+    private_data -> cache_ = *this;
+    private_data -> entry_path_ = EntryPath(key);
+    private_data -> temp_path_ = directory_ / (key + "." + std::to_string(temp_counter++) + kTempExtension);
+
+    nanoarrow::UniqueSchema schema;
+    struct ArrowError error {};
+    std::error_code ec;
+    std::filesystem::create_directories(directory_, ec);
+    if (ec || stream -> get_schema(stream, schema.get()) != 0 ||
+        ArrowArrayViewInitFromSchema(private_data -> view_.get(), schema.get(), &error) != NANOARROW_OK) {
+        return;
+    }
+
+    const auto file = OpenForWrite(private_data -> temp_path_);
+    if (file == nullptr) {
+        return;
+    }
+    // Until writing_ is set, the file is not removed on its own.
+    const auto discard_file = [&private_data] {
+        std::error_code ec;
+        std::filesystem::remove(private_data -> temp_path_, ec);
+    };
+    struct ArrowIpcOutputStream output {};
+    if (ArrowIpcOutputStreamInitFile(&output, file, 1) != NANOARROW_OK) {
+        std::fclose(file);
+        discard_file();
+        return;
+    }
+    if (ArrowIpcWriterInit(&private_data -> writer_, &output) != NANOARROW_OK) {
+        output.release(&output);
+        discard_file();
+        return;
+    }
+    private_data -> writing_ = true;
+    if (ArrowIpcWriterWriteSchema(&private_data -> writer_, schema.get(), &error) != NANOARROW_OK) {
+        return;
+    }
+
+    ArrowArrayStreamMove(stream, private_data -> source_.get());
+
+    stream -> private_data = private_data.release();
+    stream -> get_schema = [](struct ArrowArrayStream* stream, struct ArrowSchema* out) {
+        auto private_data = static_cast<CacheWriterPrivate*>(stream -> private_data);
+        return private_data -> source_ -> get_schema(private_data -> source_.get(), out);
+    };
+    stream -> get_next = [](struct ArrowArrayStream* stream, struct ArrowArray* out) {
+        auto private_data = static_cast<CacheWriterPrivate*>(stream -> private_data);
+        const auto errcode = private_data -> source_ -> get_next(private_data -> source_.get(), out);
+        if (errcode != 0) {
+            private_data -> Abandon();
+        } else if (out -> release == nullptr) {
+            private_data -> Publish();
+        } else {
+            private_data -> Write(out);
+        }
+        return errcode;
+    };
+    stream -> get_last_error = [](struct ArrowArrayStream* stream) {
+        auto private_data = static_cast<CacheWriterPrivate*>(stream -> private_data);
+        return private_data -> source_ -> get_last_error(private_data -> source_.get());
+    };
+    stream -> release = [](struct ArrowArrayStream* stream) {
+        delete static_cast<CacheWriterPrivate*>(stream -> private_data);
+        stream -> release = nullptr;
+    };
+}
+
+auto ResultCache::Evict() const noexcept -> void {
+    struct Entry {
+        std::filesystem::path path;
+        std::filesystem::file_time_type last_used;
+        uint64_t size;
+    };
+
+    try {
+        std::vector<Entry> entries;
+        uint64_t total_bytes = 0;
+        const auto stale_before = std::filesystem::file_time_type::clock::now() - kStaleTempAge;
+        for (const auto& file : std::filesystem::directory_iterator(directory_)) {
+            std::error_code ec;
+            if (file.path().extension() == kTempExtension) {
+                const auto last_written = file.last_write_time(ec);
+                if (!ec && last_written < stale_before) {
+                    std::filesystem::remove(file.path(), ec);
+                }
+                continue;
+            }
+            if (file.path().extension() != kEntryExtension || !file.is_regular_file(ec)) {
+                continue;
+            }
+            const auto size = file.file_size(ec);
+            const auto last_used = file.last_write_time(ec);
+            if (ec) {
+                continue;
+            }
+            entries.push_back({file.path(), last_used, size});
+            total_bytes += size;
+        }
+
+        std::sort(entries.begin(), entries.end(),
+                  [](const Entry& a, const Entry& b) { return a.last_used < b.last_used; });
+        for (const auto& entry : entries) {
+            if (total_bytes <= max_bytes_) {
+                break;
+            }
+            std::error_code ec;
+            if (std::filesystem::remove(entry.path, ec)) {
+                total_bytes -= entry.size;
+            }
+        }
+    } catch (...) {
+        // Eviction is best effort; the next publish tries again.
+    }
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+
+#include "reader_sample.hpp"
+
+// Finished query results kept as Arrow IPC stream files in one directory. Entries are
+// keyed by the .hyper file's canonical path, modification time and size, the query
+// and the read options that shape the batches, so rewriting the file invalidates
+// them. The modification time of an entry doubles as its last access time.
+class ResultCache {
+public:
+    ResultCache(std::filesystem::path directory, uint64_t max_bytes)
+        : directory_(std::move(directory)), max_bytes_(max_bytes) {}
+
+    // Returns nullopt when the .hyper file cannot be inspected, which bypasses the cache.
+    static auto MakeKey(const std::string& path,
+                        const std::string& query,
+                        const ReadOptions& options) -> std::optional<std::string>;
+
+    // Moves a stream over the cached result into out. Returns false on a miss.
+    auto Open(const std::string& key, struct ArrowArrayStream* out) const noexcept -> bool;
+
+    // Replaces stream by one that passes its batches through and publishes them under
+    // key once the stream has been read to the end. Failing to write the entry only
+    // disables caching for this stream.
+    auto Tee(const std::string& key, struct ArrowArrayStream* stream) const -> void;
+
+    // Removes the least recently used entries until the cache fits max_bytes, and
+    // temporary files that writers which died mid-entry left behind.
+    auto Evict() const noexcept -> void;
+
+private:
+    auto EntryPath(const std::string& key) const -> std::filesystem::path;
+
+    std::filesystem::path directory_;
+    uint64_t max_bytes_;
+};
@@ -0,0 +1,523 @@
+#include "sharded_reader.hpp"
+#include "column_statistics.hpp"
+#include "query_canceller.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <nanoarrow/nanoarrow.hpp>
+
+namespace {
+
+// Glob matching of a single path component with * and ?.
+auto MatchesWildcard(std::string_view pattern, std::string_view name) -> bool {
+    size_t p = 0;
+    size_t n = 0;
+    size_t star = std::string_view::npos;
+    size_t star_name = 0;
+    while (n < name.size()) {
+        if (p < pattern.size() && (pattern[p] == '?' || pattern[p] == name[n])) {
+            p++;
+            n++;
+        } else if (p < pattern.size() && pattern[p] == '*') {
+            star = p++;
+            star_name = n;
+        } else if (star != std::string_view::npos) {
+            p = star + 1;
+            n = ++star_name;
+        } else {
+            return false;
+        }
+    }
+    while (p < pattern.size() && pattern[p] == '*') {
+        p++;
+    }
+    return p == pattern.size();
+}
+
+auto SameName(const char* a, const char* b) -> bool {
+    if (a == nullptr || b == nullptr) {
+        return a == b;
+    }
+    return std::strcmp(a, b) == 0;
+}
+
+auto SchemasMatch(const struct ArrowSchema* a, const struct ArrowSchema* b) -> bool {
+    if (!SameName(a -> format, b -> format) || !SameName(a -> name, b -> name) ||
+        a -> flags != b -> flags || a -> n_children != b -> n_children ||
+        (a -> dictionary == nullptr) != (b -> dictionary == nullptr)) {
+        return false;
+    }
+    if (a -> dictionary != nullptr && !SchemasMatch(a -> dictionary, b -> dictionary)) {
+        return false;
+    }
+    for (int64_t i = 0; i < a -> n_children; i++) {
+        if (!SchemasMatch(a -> children[i], b -> children[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// The shard schema with the source column appended.
+auto MakeOutputSchema(const struct ArrowSchema* shard, const std::string& source_column,
+                      struct ArrowSchema* out) -> int {
+    ArrowSchemaInit(out);
+    NANOARROW_RETURN_NOT_OK(ArrowSchemaSetTypeStruct(out, shard -> n_children + 1));
+    for (int64_t i = 0; i < shard -> n_children; i++) {
+        ArrowSchemaRelease(out -> children[i]);
+        NANOARROW_RETURN_NOT_OK(ArrowSchemaDeepCopy(shard -> children[i], out -> children[i]));
+    }
+
+    auto source = out -> children[shard -> n_children];
+    ArrowSchemaRelease(source);
+    NANOARROW_RETURN_NOT_OK(ArrowSchemaInitFromType(source, NANOARROW_TYPE_INT32));
+    NANOARROW_RETURN_NOT_OK(ArrowSchemaSetName(source, source_column.c_str()));
+    source -> flags = 0;
+    NANOARROW_RETURN_NOT_OK(ArrowSchemaAllocateDictionary(source));
+    return ArrowSchemaInitFromType(source -> dictionary, NANOARROW_TYPE_LARGE_STRING);
+}
+
+// Keeps the decoded batch alive under a parent that borrows its children, so that
+// the columns are not copied to append the source column.
+struct SourceBatchPrivate {
+    struct ArrowArray batch {};
+    struct ArrowArray source {};
+    std::vector<struct ArrowArray*> children;
+    const void* buffers[1] = {nullptr};
+};
+
+auto ReleaseSourceBatch(struct ArrowArray* array) -> void {
+    auto private_data = static_cast<SourceBatchPrivate*>(array -> private_data);
+    if (private_data -> batch.release != nullptr) {
+        ArrowArrayRelease(&private_data -> batch);
+    }
+    if (private_data -> source.release != nullptr) {
+        ArrowArrayRelease(&private_data -> source);
+    }
+    delete private_data;
+    array -> release = nullptr;
+}
+
+// Moves batch into out with a column of one dictionary entry, path, appended.
+auto AppendSourceColumn(struct ArrowArray* batch, const struct ArrowSchema* source_schema,
+                        const std::string& path, struct ArrowArray* out, struct ArrowError* error) -> int {
+    auto private_data = std::make_unique<SourceBatchPrivate>();
+    NANOARROW_RETURN_NOT_OK(ArrowArrayInitFromSchema(&private_data -> source, source_schema, error));
+    NANOARROW_RETURN_NOT_OK(ArrowArrayStartAppending(&private_data -> source));
+
+    // Indices cover the parent offset as well, as the children are read through it.
+    const auto rows = batch -> offset + batch -> length;
+    NANOARROW_RETURN_NOT_OK(ArrowArrayReserve(&private_data -> source, rows));
+    for (int64_t i = 0; i < rows; i++) {
+        NANOARROW_RETURN_NOT_OK(ArrowArrayAppendInt(&private_data -> source, 0));
+    }
+    NANOARROW_RETURN_NOT_OK(ArrowArrayAppendString(private_data -> source.dictionary, ArrowCharView(path.c_str())));
+    NANOARROW_RETURN_NOT_OK(ArrowArrayFinishBuildingDefault(&private_data -> source, error));
+
+    ArrowArrayMove(batch, &private_data -> batch);
+    private_data -> children.assign(private_data -> batch.children,
+                                    private_data -> batch.children + private_data -> batch.n_children);
+    private_data -> children.push_back(&private_data -> source);
+
+    out -> length = private_data -> batch.length;
+    out -> null_count = 0;
+    out -> offset = private_data -> batch.offset;
+    out -> n_buffers = 1;
+    out -> buffers = private_data -> buffers;
+    out -> n_children = static_cast<int64_t>(private_data -> children.size());
+    out -> children = private_data -> children.data();
+    out -> dictionary = nullptr;
+    out -> release = ReleaseSourceBatch;
+    out -> private_data = private_data.release();
+    return NANOARROW_OK;
+}
+
+// Reads every shard on a pool of worker threads into a bounded queue that the
+// consumer drains through the ArrowArrayStream callbacks.
+class ShardedStream {
+public:
+    ShardedStream(std::vector<std::string> paths, std::string query, ShardedReadOptions options)
+        : paths_(std::move(paths)), query_(std::move(query)), options_(std::move(options)),
+          canceller_(std::make_shared<QueryCanceller>(nullptr)) {
+        if (options_.read.compute_statistics) {
+            statistics_ = std::make_shared<BatchStatistics>();
+        }
+        if (options_.read.timeout.count() > 0) {
+            deadline_ = std::chrono::steady_clock::now() + options_.read.timeout;
+            CancelAtDeadline(canceller_, *deadline_);
+        }
+
+        const auto worker_count = std::min(std::max<size_t>(options_.max_concurrency, 1), paths_.size());
+        cancellers_.resize(worker_count);
+        running_workers_ = worker_count;
+        try {
+            workers_.reserve(worker_count);
+            for (size_t i = 0; i < worker_count; i++) {
+                workers_.emplace_back(&ShardedStream::Work, this, i);
+            }
+        } catch (...) {
+            {
+                const std::lock_guard lock(mutex_);
+                running_workers_ -= worker_count - workers_.size();
+            }
+            Stop();
+            throw;
+        }
+    }
+
+    ShardedStream(const ShardedStream&) = delete;
+    ShardedStream &operator=(const ShardedStream&) = delete;
+
+    ~ShardedStream() {
+        Stop();
+    }
+
+    auto Canceller() const -> std::shared_ptr<QueryCanceller> { return canceller_; }
+    auto Statistics() const -> std::shared_ptr<BatchStatistics> { return statistics_; }
+
+    auto GetSchema(struct ArrowSchema* out) -> int {
+        FailIfCancelled();
+        std::unique_lock lock(mutex_);
+        ready_cv_.wait(lock, [this] { return schema_ready_ || errcode_ != 0 || running_workers_ == 0; });
+        if (errcode_ != 0) {
+            return errcode_;
+        }
+        if (!schema_ready_) {
+            error_ = "no shard produced a schema";
+            return EINVAL;
+        }
+        return ArrowSchemaDeepCopy(schema_.get(), out);
+    }
+
+    auto GetNext(struct ArrowArray* out) -> int {
+        FailIfCancelled();
+        std::unique_lock lock(mutex_);
+        ready_cv_.wait(lock, [this] { return !queue_.empty() || errcode_ != 0 || running_workers_ == 0; });
+        if (errcode_ != 0) {
+            return errcode_;
+        }
+        if (queue_.empty()) {
+            out -> release = nullptr;
+            return 0;
+        }
+
+        queue_.front().batch.move(out);
+        if (statistics_) {
+            *statistics_ = std::move(queue_.front().statistics);
+        }
+        queue_.pop_front();
+        lock.unlock();
+        space_cv_.notify_one();
+        return 0;
+    }
+
+    auto GetLastError() const -> const char* {
+        return error_.c_str();
+    }
+
+private:
+    auto Work(size_t worker) -> void {
+        while (!IsStopping()) {
+            const auto index = next_shard_.fetch_add(1);
+            if (index >= paths_.size()) {
+                break;
+            }
+
+            try {
+                ReadShard(worker, index);
+            } catch (...) {
+                struct ArrowError error {};
+                const auto errcode = stream_error_from_exception(&error);
+                Fail(errcode, paths_[index] + ": " + error.message);
+            }
+        }
+
+        {
+            const std::lock_guard lock(mutex_);
+            running_workers_--;
+        }
+        ready_cv_.notify_all();
+    }
+
+    auto ReadShard(size_t worker, size_t index) -> void {
+        if (FailIfCancelled()) {
+            return;
+        }
+
+        auto read = options_.read;
+        if (deadline_) {
+            const auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+                *deadline_ - std::chrono::steady_clock::now());
+            if (remaining.count() <= 0) {
+                throw QueryCancelledError(QueryCanceller::Reason::DeadlineExceeded);
+            }
+            read.timeout = remaining;
+        }
+
+        auto result = read_from_hyper_query(paths_[index], query_, read);
+        nanoarrow::UniqueArrayStream stream;
+        ArrowArrayStreamMove(static_cast<struct ArrowArrayStream*>(const_cast<void*>(result.data)), stream.get());
+        result.release(const_cast<void*>(result.data));
+        {
+            const std::lock_guard lock(mutex_);
+            if (stopping_) {
+                return;
+            }
+            cancellers_[worker] = result.canceller;
+        }
+        if (result.canceller) {
+            canceller_ -> Forward(result.canceller);
+        }
+
+        const auto path = paths_[index];
+        const auto fail = [&](int errcode) {
+            const char* message = stream -> get_last_error(stream.get());
+            Fail(errcode, path + ": " + (message != nullptr ? message : "read failed"));
+        };
+
+        nanoarrow::UniqueSchema schema;
+        if (const auto errcode = stream -> get_schema(stream.get(), schema.get()); errcode != 0) {
+            fail(errcode);
+        } else if (CheckSchema(schema.get(), path)) {
+            // Cached shards run no query that a cancel could interrupt.
+            while (!IsStopping() && !FailIfCancelled()) {
+                nanoarrow::UniqueArray batch;
+                if (const auto errcode = stream -> get_next(stream.get(), batch.get()); errcode != 0) {
+                    fail(errcode);
+                    break;
+                }
+                if (batch -> release == nullptr) {
+                    break;
+                }
+                if (!Push(std::move(batch), result.statistics.get(), path)) {
+                    break;
+                }
+            }
+        }
+
+        const std::lock_guard lock(mutex_);
+        cancellers_[worker].reset();
+    }
+
+    // Adopts the first schema seen and fails on any shard that differs from it.
+    auto CheckSchema(const struct ArrowSchema* schema, const std::string& path) -> bool {
+        std::unique_lock lock(mutex_);
+        if (schema_ready_) {
+            if (SchemasMatch(schema, shard_schema_.get())) {
+                return true;
+            }
+            lock.unlock();
+            Fail(EINVAL, path + ": result schema differs from the other shards");
+            return false;
+        }
+
+        int errcode = ArrowSchemaDeepCopy(schema, shard_schema_.get());
+        if (errcode == NANOARROW_OK) {
+            errcode = options_.source_column.empty()
+                ? ArrowSchemaDeepCopy(schema, schema_.get())
+                : MakeOutputSchema(schema, options_.source_column, schema_.get());
+        }
+        if (errcode == NANOARROW_OK && !options_.source_column.empty()) {
+            errcode = ArrowSchemaDeepCopy(schema_ -> children[schema_ -> n_children - 1], source_schema_.get());
+        }
+        if (errcode != NANOARROW_OK) {
+            lock.unlock();
+            Fail(errcode, path + ": failed to build the merged schema");
+            return false;
+        }
+        schema_ready_ = true;
+        lock.unlock();
+        ready_cv_.notify_all();
+        return true;
+    }
+
+    // Waits for room in the queue. Returns false once the stream is stopping.
+    // statistics, when requested, are those of batch and are copied along with it.
+    auto Push(nanoarrow::UniqueArray batch, const BatchStatistics* statistics, const std::string& path) -> bool {
+        QueuedBatch tagged;
+        if (!options_.source_column.empty()) {
+            struct ArrowError error {};
+            if (const auto errcode = AppendSourceColumn(batch.get(), source_schema_.get(), path, tagged.batch.get(), &error);
+                errcode != NANOARROW_OK) {
+                Fail(errcode, path + ": " + error.message);
+                return false;
+            }
+        } else {
+            tagged.batch = std::move(batch);
+        }
+        if (statistics_ && statistics != nullptr) {
+            tagged.statistics = *statistics;
+            if (!options_.source_column.empty()) {
+                tagged.statistics.columns.emplace_back().AddBytes(path);
+            }
+        }
+
+        std::unique_lock lock(mutex_);
+        const auto capacity = std::max<size_t>(options_.queue_batches, 1);
+        space_cv_.wait(lock, [&] { return stopping_ || errcode_ != 0 || queue_.size() < capacity; });
+        if (stopping_ || errcode_ != 0) {
+            return false;
+        }
+        queue_.push_back(std::move(tagged));
+        lock.unlock();
+        ready_cv_.notify_one();
+        return true;
+    }
+
+    // Keeps the first failure and stops the remaining shards.
+    auto Fail(int errcode, std::string message) -> void {
+        {
+            const std::lock_guard lock(mutex_);
+            if (errcode_ == 0) {
+                errcode_ = errcode;
+                error_ = std::move(message);
+            }
+            CancelRunning();
+        }
+        ready_cv_.notify_all();
+        space_cv_.notify_all();
+    }
+
+    auto Stop() -> void {
+        {
+            const std::lock_guard lock(mutex_);
+            stopping_ = true;
+            CancelRunning();
+        }
+        space_cv_.notify_all();
+        for (auto& worker : workers_) {
+            worker.join();
+        }
+        workers_.clear();
+    }
+
+    // Requires mutex_.
+    auto CancelRunning() -> void {
+        for (const auto& canceller : cancellers_) {
+            if (canceller) {
+                canceller -> Cancel();
+            }
+        }
+    }
+
+    // Turns a cancel through Result::canceller, or the deadline passing, into a
+    // failure of the stream. Returns whether that happened.
+    auto FailIfCancelled() -> bool {
+        const auto reason = canceller_ -> GetReason();
+        if (reason == QueryCanceller::Reason::None) {
+            return false;
+        }
+        Fail(reason == QueryCanceller::Reason::DeadlineExceeded ? ETIMEDOUT : ECANCELED,
+             QueryCancelledError(reason).what());
+        return true;
+    }
+
+    auto IsStopping() -> bool {
+        const std::lock_guard lock(mutex_);
+        return stopping_ || errcode_ != 0;
+    }
+
+    std::vector<std::string> paths_;
+    std::string query_;
+    ShardedReadOptions options_;
+    // Handed out as Result::canceller and forwarded to every shard's query.
+    std::shared_ptr<QueryCanceller> canceller_;
+    std::shared_ptr<BatchStatistics> statistics_;
+    std::optional<std::chrono::steady_clock::time_point> deadline_;
+    std::atomic<size_t> next_shard_{0};
+
+    std::mutex mutex_;
+    std::condition_variable ready_cv_;
+    std::condition_variable space_cv_;
+    struct QueuedBatch {
+        nanoarrow::UniqueArray batch;
+        BatchStatistics statistics;
+    };
+    std::deque<QueuedBatch> queue_;
+    nanoarrow::UniqueSchema shard_schema_;
+    nanoarrow::UniqueSchema schema_;
+    nanoarrow::UniqueSchema source_schema_;
+    bool schema_ready_ = false;
+    bool stopping_ = false;
+    size_t running_workers_ = 0;
+    int errcode_ = 0;
+    std::string error_;
+    // The query each worker is reading, cancelled when the stream stops early.
+    std::vector<std::shared_ptr<QueryCanceller>> cancellers_;
+
+    std::vector<std::thread> workers_;
+};
+
+} // namespace
+
+auto expand_hyper_paths(const std::string& pattern)-> std::vector<std::string> {
+    const std::filesystem::path path(pattern);
+    const auto file_pattern = path.filename().string();
+    if (file_pattern.find_first_of("*?") == std::string::npos) {
+        return {pattern};
+    }
+
+    const auto directory = path.has_parent_path() ? path.parent_path() : std::filesystem::path(".");
+    std::vector<std::string> paths;
+    for (const auto& entry : std::filesystem::directory_iterator(directory)) {
+        std::error_code ec;
+        if (entry.is_regular_file(ec) && MatchesWildcard(file_pattern, entry.path().filename().string())) {
+            paths.push_back(path.has_parent_path() ? entry.path().string() : entry.path().filename().string());
+        }
+    }
+    std::sort(paths.begin(), paths.end());
+    return paths;
+}
+
+auto read_from_hyper_shards(const std::vector<std::string>& paths,
+                            const std::string& query,
+                            const ShardedReadOptions& options)-> Result {
+    if (paths.empty()) {
+        throw std::invalid_argument("no shard to read");
+    }
+
+    auto sharded = std::make_unique<ShardedStream>(paths, query, options);
+    auto canceller = sharded -> Canceller();
+    auto statistics = sharded -> Statistics();
+
+    struct ArrowArrayStream stream {};
+    stream.private_data = sharded.release();
+    stream.get_schema = [](struct ArrowArrayStream* stream, struct ArrowSchema* out) {
+        return static_cast<ShardedStream*>(stream -> private_data) -> GetSchema(out);
+    };
+    stream.get_next = [](struct ArrowArrayStream* stream, struct ArrowArray* out) {
+        return static_cast<ShardedStream*>(stream -> private_data) -> GetNext(out);
+    };
+    stream.get_last_error = [](struct ArrowArrayStream* stream) {
+        return static_cast<ShardedStream*>(stream -> private_data) -> GetLastError();
+    };
+    stream.release = [](struct ArrowArrayStream* stream) {
+        delete static_cast<ShardedStream*>(stream -> private_data);
+        stream -> release = nullptr;
+    };
+
+    Result result;
+    try {
+        result = make_stream_result(&stream);
+    } catch (...) {
+        stream.release(&stream);
+        throw;
+    }
+    result.canceller = std::move(canceller);
+    result.statistics = std::move(statistics);
+    return result;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "reader_sample.hpp"
+
+struct ShardedReadOptions {
+    // Files read at the same time, each on its own pooled connection.
+    size_t max_concurrency = 4;
+    // Batches decoded ahead of the consumer across all files. Readers wait once the
+    // queue is full, which bounds memory to roughly this many batches.
+    size_t queue_batches = 16;
+    // When set, every batch gets a trailing dictionary encoded column of this name
+    // holding the path of the file it was read from.
+    std::string source_column;
+    // Applied to every file. A timeout covers the whole fan-in, not each file.
+    ReadOptions read{};
+};
+
+// Expands a path whose last component may contain * and ? into the matching
+// regular files, sorted by name. Paths without wildcards are returned unchanged.
+auto expand_hyper_paths(const std::string& pattern)-> std::vector<std::string>;
+
+// Runs query against every file and merges the results into one stream. Batches
+// are emitted in the order they are decoded, so rows of different files interleave.
+// Every file must produce the schema of the first one; a mismatch or a failed file
+// fails the stream and stops the others. Releasing the stream early or cancelling
+// it through Result::canceller stops the queries still running. Statistics describe
+// the emitted batch like those of a single file, with the source column counted
+// as one distinct value.
+auto read_from_hyper_shards(const std::vector<std::string>& paths,
+                            const std::string& query,
+                            const ShardedReadOptions& options)-> Result;
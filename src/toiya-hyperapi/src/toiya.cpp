@@ -0,0 +1,698 @@
+#include "toiya.h"
+#include "arrow_query.hpp"
+#include "column_statistics.hpp"
+#include "hyper_cursor.hpp"
+#include "hyper_preview.hpp"
+#include "hyper_writer.hpp"
+#include "late_materialization.hpp"
+#include "prepared_query.hpp"
+#include "query_batch.hpp"
+#include "query_canceller.hpp"
+#include "reader_sample.hpp"
+#include "sharded_reader.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <stdexcept>
+
+#include <hyperapi/hyperapi.hpp>
+#include <nanoarrow/nanoarrow.hpp>
+
+struct toiya_stream {
+    struct ArrowArrayStream stream {};
+    std::shared_ptr<QueryCanceller> canceller;
+    std::shared_ptr<BatchStatistics> statistics;
+    // What toiya_stream_statistics handed out last; points into statistics.
+    std::vector<toiya_column_statistics> exported_statistics;
+};
+
+struct toiya_batch {
+    std::unique_ptr<QueryBatch> batch;
+};
+
+struct toiya_cursor {
+    std::shared_ptr<HyperCursor> cursor;
+};
+
+namespace {
+    auto SetError(toiya_error* error, toiya_status code, const char* message) -> toiya_status {
+        if (error != nullptr) {
+            error -> code = code;
+            std::snprintf(error -> message, sizeof(error -> message), "%s", message);
+        }
+        return code;
+    }
+
+    auto SetErrorFromException(toiya_error* error) -> toiya_status {
+        try {
+            throw;
+        } catch (const QueryCancelledError& e) {
+            const auto code = e.GetReason() == QueryCanceller::Reason::DeadlineExceeded
+                ? TOIYA_ERROR_DEADLINE_EXCEEDED : TOIYA_ERROR_CANCELLED;
+            return SetError(error, code, e.what());
+        } catch (const hyperapi::HyperException& e) {
+            return SetError(error, TOIYA_ERROR_HYPER, e.what());
+        } catch (const std::bad_alloc&) {
+            return SetError(error, TOIYA_ERROR_OUT_OF_MEMORY, "out of memory");
+        } catch (const CursorClosedError& e) {
+            return SetError(error, TOIYA_ERROR_CURSOR_CLOSED, e.what());
+        } catch (const std::invalid_argument& e) {
+            return SetError(error, TOIYA_ERROR_INVALID_ARGUMENT, e.what());
+        } catch (const std::exception& e) {
+            return SetError(error, TOIYA_ERROR_INTERNAL, e.what());
+        } catch (...) {
+            return SetError(error, TOIYA_ERROR_INTERNAL, "unknown error");
+        }
+    }
+
+    // Maps the errno style codes of the ArrowArrayStream callbacks.
+    auto StatusFromErrno(int errcode) -> toiya_status {
+        switch (errcode) {
+            case EIO: return TOIYA_ERROR_HYPER;
+            case ENOMEM: return TOIYA_ERROR_OUT_OF_MEMORY;
+            case EINVAL: return TOIYA_ERROR_CONVERSION;
+            case ECANCELED: return TOIYA_ERROR_CANCELLED;
+            case ETIMEDOUT: return TOIYA_ERROR_DEADLINE_EXCEEDED;
+            default: return TOIYA_ERROR_INTERNAL;
+        }
+    }
+
+    auto StreamError(toiya_stream* stream, int errcode, toiya_error* error) -> toiya_status {
+        const auto message = stream -> stream.get_last_error(&stream -> stream);
+        return SetError(error, StatusFromErrno(errcode), message != nullptr ? message : "unknown error");
+    }
+
+    // Takes over the stream owned by result, also when allocating the handle fails.
+    auto MakeStreamHandle(const Result& result) -> toiya_stream* {
+        auto arrow_stream = static_cast<struct ArrowArrayStream*>(const_cast<void*>(result.data));
+        std::unique_ptr<toiya_stream> stream;
+        try {
+            stream = std::make_unique<toiya_stream>();
+        } catch (...) {
+            result.release(arrow_stream);
+            throw;
+        }
+
+        ArrowArrayStreamMove(arrow_stream, &stream -> stream);
+        result.release(arrow_stream);
+        stream -> canceller = result.canceller;
+        stream -> statistics = result.statistics;
+
+        return stream.release();
+    }
+
+    auto ToReadOptions(const toiya_read_options* options) -> ReadOptions {
+        toiya_read_options c_options{};
+        toiya_read_options_init(&c_options);
+        if (options != nullptr) {
+            std::memcpy(&c_options, options, std::min(options -> struct_size, sizeof(c_options)));
+        }
+
+        ReadOptions read_options{};
+        read_options.chunk_size = c_options.chunk_size;
+        read_options.target_batch_bytes = c_options.target_batch_bytes;
+        read_options.buffer_pool_bytes = c_options.buffer_pool_bytes;
+        read_options.allocator = c_options.allocator;
+        for (size_t i = 0; i < c_options.not_null_column_count; i++) {
+            read_options.not_null_columns.emplace_back(c_options.not_null_columns[i]);
+        }
+        if (c_options.nullability_table != nullptr) {
+            read_options.nullability_table = c_options.nullability_table;
+        }
+        if (c_options.hyper_path != nullptr) {
+            read_options.hyper_path = c_options.hyper_path;
+        }
+        read_options.timeout = std::chrono::milliseconds(c_options.timeout_ms);
+        if (c_options.cache_dir != nullptr) {
+            read_options.cache_dir = c_options.cache_dir;
+        }
+        read_options.cache_max_bytes = c_options.cache_max_bytes;
+        read_options.compute_statistics = c_options.compute_statistics != 0;
+        read_options.single_batch = c_options.single_batch != 0;
+
+        return read_options;
+    }
+
+    auto ToQueryParameter(const toiya_parameter& parameter) -> QueryParameter {
+        QueryParameter converted{hyperapi::SqlType::text(), std::nullopt};
+        switch (parameter.type) {
+            case TOIYA_PARAMETER_BOOL: converted.type = hyperapi::SqlType::boolean(); break;
+            case TOIYA_PARAMETER_BIGINT: converted.type = hyperapi::SqlType::bigInt(); break;
+            case TOIYA_PARAMETER_DOUBLE: converted.type = hyperapi::SqlType::doublePrecision(); break;
+            case TOIYA_PARAMETER_TEXT: converted.type = hyperapi::SqlType::text(); break;
+            case TOIYA_PARAMETER_DATE: converted.type = hyperapi::SqlType::date(); break;
+            case TOIYA_PARAMETER_TIMESTAMP: converted.type = hyperapi::SqlType::timestamp(); break;
+            case TOIYA_PARAMETER_TIMESTAMP_TZ: converted.type = hyperapi::SqlType::timestampTZ(); break;
+            default: throw std::invalid_argument("unknown parameter type");
+        }
+        if (parameter.is_null) {
+            return converted;
+        }
+
+        switch (parameter.type) {
+            case TOIYA_PARAMETER_BOOL: converted.value = parameter.int_value != 0; break;
+            case TOIYA_PARAMETER_BIGINT: converted.value = parameter.int_value; break;
+            case TOIYA_PARAMETER_DOUBLE: converted.value = parameter.double_value; break;
+            default:
+                if (parameter.text_value == nullptr) {
+                    throw std::invalid_argument("text_value must not be NULL unless is_null is set");
+                }
+                converted.value = std::string(parameter.text_value);
+        }
+        return converted;
+    }
+
+    auto ToWriteOptions(const toiya_write_options* options) -> ArrowWriteOptions {
+        toiya_write_options c_options{};
+        toiya_write_options_init(&c_options);
+        if (options != nullptr) {
+            std::memcpy(&c_options, options, std::min(options -> struct_size, sizeof(c_options)));
+        }
+
+        ArrowWriteOptions write_options{};
+        write_options.commitRows = c_options.commit_rows;
+        if (c_options.hyper_path != nullptr) {
+            write_options.hyperPath = c_options.hyper_path;
+        }
+
+        return write_options;
+    }
+
+    // Releases the caller's stream on every path out of the functions consuming it.
+    struct StreamReleaser {
+        struct ArrowArrayStream* stream;
+        ~StreamReleaser() {
+            if (stream != nullptr && stream -> release != nullptr) {
+                ArrowArrayStreamRelease(stream);
+            }
+        }
+    };
+
+    struct TableStreamsReleaser {
+        const toiya_arrow_table* tables;
+        size_t count;
+        ~TableStreamsReleaser() {
+            for (size_t i = 0; tables != nullptr && i < count; i++) {
+                if (tables[i].stream != nullptr && tables[i].stream -> release != nullptr) {
+                    ArrowArrayStreamRelease(tables[i].stream);
+                }
+            }
+        }
+    };
+}
+
+extern "C" {
+    uint32_t toiya_abi_version(void) {
+        return TOIYA_ABI_VERSION;
+    }
+
+    void toiya_read_options_init(toiya_read_options* options) {
+        *options = toiya_read_options{};
+        options -> struct_size = sizeof(toiya_read_options);
+        options -> buffer_pool_bytes = ReadOptions{}.buffer_pool_bytes;
+        options -> cache_max_bytes = ReadOptions{}.cache_max_bytes;
+    }
+
+    toiya_status toiya_stream_open(const char* path,
+                                   const char* query,
+                                   const toiya_read_options* options,
+                                   toiya_stream** out,
+                                   toiya_error* error) {
+        if (path == nullptr || query == nullptr || out == nullptr) {
+            return SetError(error, TOIYA_ERROR_INVALID_ARGUMENT, "path, query and out must not be NULL");
+        }
+
+        try {
+            const auto result = read_from_hyper_query(path, query, ToReadOptions(options));
+            *out = MakeStreamHandle(result);
+            return SetError(error, TOIYA_OK, "");
+        } catch (...) {
+            return SetErrorFromException(error);
+        }
+    }
+
+    toiya_status toiya_stream_get_schema(toiya_stream* stream,
+                                         struct ArrowSchema* out,
+                                         toiya_error* error) {
+        if (stream == nullptr || out == nullptr || stream -> stream.release == nullptr) {
+            return SetError(error, TOIYA_ERROR_INVALID_ARGUMENT, "stream is NULL or has been exported");
+        }
+
+        if (const auto errcode = stream -> stream.get_schema(&stream -> stream, out)) {
+            return StreamError(stream, errcode, error);
+        }
+        return SetError(error, TOIYA_OK, "");
+    }
+
+    toiya_status toiya_stream_next(toiya_stream* stream,
+                                   struct ArrowArray* out,
+                                   toiya_error* error) {
+        if (stream == nullptr || out == nullptr) {
+            return SetError(error, TOIYA_ERROR_INVALID_ARGUMENT, "stream and out must not be NULL");
+        }
+
+        out -> release = nullptr;
+        if (stream -> stream.release == nullptr) {
+            return SetError(error, TOIYA_OK, "");
+        }
+
+        if (const auto errcode = stream -> stream.get_next(&stream -> stream, out)) {
+            return StreamError(stream, errcode, error);
+        }
+        return SetError(error, TOIYA_OK, "");
+    }
+
+    toiya_status toiya_stream_export(toiya_stream* stream,
+                                     struct ArrowArrayStream* out,
+                                     toiya_error* error) {
+        if (stream == nullptr || out == nullptr || stream -> stream.release == nullptr) {
+            return SetError(error, TOIYA_ERROR_INVALID_ARGUMENT, "stream is NULL or has been exported");
+        }
+
+        ArrowArrayStreamMove(&stream -> stream, out);
+        return SetError(error, TOIYA_OK, "");
+    }
+
+    void toiya_stream_cancel(toiya_stream* stream) {
+        if (stream != nullptr && stream -> canceller) {
+            stream -> canceller -> Cancel();
+        }
+    }
+
+    void toiya_stream_free(toiya_stream* stream) {
+        if (stream == nullptr) {
+            return;
+        }
+        if (stream -> stream.release != nullptr) {
+            ArrowArrayStreamRelease(&stream -> stream);
+        }
+        delete stream;
+    }
+
+    toiya_status toiya_preview_table(const char* path,
+                                     const char* table,
+                                     size_t rows,
+                                     double percent,
+                                     const toiya_read_options* options,
+                                     toiya_stream** out,
+                                     toiya_error* error) {
+        if (path == nullptr || table == nullptr || out == nullptr) {
+            return SetError(error, TOIYA_ERROR_INVALID_ARGUMENT, "path, table and out must not be NULL");
+        }
+
+        try {
+            PreviewOptions preview_options{};
+            preview_options.rows = rows;
+            preview_options.percent = percent;
+            preview_options.read = ToReadOptions(options);
+
+            *out = MakeStreamHandle(preview_hyper_table(path, table, preview_options));
+            return SetError(error, TOIYA_OK, "");
+        } catch (...) {
+            return SetErrorFromException(error);
+        }
+    }
+
+    toiya_status toiya_preview_query(const char* path,
+                                     const char* query,
+                                     size_t rows,
+                                     double percent,
+                                     const toiya_read_options* options,
+                                     toiya_stream** out,
+                                     toiya_error* error) {
+        if (path == nullptr || query == nullptr || out == nullptr) {
+            return SetError(error, TOIYA_ERROR_INVALID_ARGUMENT, "path, query and out must not be NULL");
+        }
+
+        try {
+            PreviewOptions preview_options{};
+            preview_options.rows = rows;
+            preview_options.percent = percent;
+            preview_options.read = ToReadOptions(options);
+
+            *out = MakeStreamHandle(preview_hyper_query(path, query, preview_options));
+            return SetError(error, TOIYA_OK, "");
+        } catch (...) {
+            return SetErrorFromException(error);
+        }
+    }
+
+    toiya_status toiya_stream_statistics(toiya_stream* stream,
+                                         const toiya_column_statistics** statistics,
+                                         size_t* column_count,
+                                         toiya_error* error) {
+        if (stream == nullptr || statistics == nullptr || column_count == nullptr) {
+            return SetError(error, TOIYA_ERROR_INVALID_ARGUMENT, "stream, statistics and column_count must not be NULL");
+        }
+        if (!stream -> statistics) {
+            return SetError(error, TOIYA_ERROR_INVALID_ARGUMENT, "the stream was opened without compute_statistics");
+        }
+
+        try {
+            const auto& columns = stream -> statistics -> columns;
+            auto& exported = stream -> exported_statistics;
+            exported.resize(columns.size());
+
+            for (size_t i = 0; i < columns.size(); i++) {
+                const auto& column = columns[i];
+                auto& out = exported[i];
+                out = toiya_column_statistics{};
+                out.null_count = column.GetNullCount();
+                out.distinct_estimate = column.GetDistinctEstimate();
+
+                switch (column.GetKind()) {
+                    case ColumnStatistics::Kind::None:
+                        out.kind = TOIYA_STATISTICS_NONE;
+                        break;
+                    case ColumnStatistics::Kind::Int:
+                        out.kind = TOIYA_STATISTICS_INT;
+                        out.min_int = column.GetMinInt();
+                        out.max_int = column.GetMaxInt();
+                        break;
+                    case ColumnStatistics::Kind::Double:
+                        out.kind = TOIYA_STATISTICS_DOUBLE;
+                        out.min_double = column.GetMinDouble();
+                        out.max_double = column.GetMaxDouble();
+                        break;
+                    case ColumnStatistics::Kind::Bytes:
+                        out.kind = TOIYA_STATISTICS_BYTES;
+                        out.min_bytes = reinterpret_cast<const uint8_t*>(column.GetMinBytes().data());
+                        out.min_bytes_size = static_cast<int64_t>(column.GetMinBytes().size());
+                        out.max_bytes = reinterpret_cast<const uint8_t*>(column.GetMaxBytes().data());
+                        out.max_bytes_size = static_cast<int64_t>(column.GetMaxBytes().size());
+                        break;
+                }
+            }
+
+            *statistics = exported.data();
+            *column_count = exported.size();
+            return SetError(error, TOIYA_OK, "");
+        } catch (...) {
+            return SetErrorFromException(error);
+        }
+    }
+
+    toiya_status toiya_cursor_open(const char* path,
+                                   const char* query,
+                                   const char* order_by,
+                                   uint64_t idle_timeout_ms,
+                                   const toiya_read_options* options,
+                                   toiya_cursor** out,
+                                   toiya_error* error) {
+        if (path == nullptr || query == nullptr || out == nullptr) {
+            return SetError(error, TOIYA_ERROR_INVALID_ARGUMENT, "path, query and out must not be NULL");
+        }
+
+        try {
+            CursorOptions cursor_options{};
+            if (order_by != nullptr) {
+                cursor_options.order_by = order_by;
+            }
+            cursor_options.idle_timeout = std::chrono::milliseconds(idle_timeout_ms);
+            cursor_options.read = ToReadOptions(options);
+
+            auto cursor = std::make_unique<toiya_cursor>();
+            cursor -> cursor = HyperCursor::Open(path, query, cursor_options);
+
+            *out = cursor.release();
+            return SetError(error, TOIYA_OK, "");
+        } catch (...) {
+            return SetErrorFromException(error);
+        }
+    }
+
+    toiya_status toiya_cursor_row_count(toiya_cursor* cursor,
+                                        int64_t* row_count,
+                                        toiya_error* error) {
+        if (cursor == nullptr || row_count == nullptr) {
+            return SetError(error, TOIYA_ERROR_INVALID_ARGUMENT, "cursor and row_count must not be NULL");
+        }
+
+        *row_count = cursor -> cursor -> RowCount();
+        return SetError(error, TOIYA_OK, "");
+    }
+
+    toiya_status toiya_cursor_fetch(toiya_cursor* cursor,
+                                    int64_t offset,
+                                    int64_t count,
+                                    toiya_stream** out,
+                                    toiya_error* error) {
+        if (cursor == nullptr || out == nullptr) {
+            return SetError(error, TOIYA_ERROR_INVALID_ARGUMENT, "cursor and out must not be NULL");
+        }
+
+        try {
+            *out = MakeStreamHandle(cursor -> cursor -> Fetch(offset, count));
+            return SetError(error, TOIYA_OK, "");
+        } catch (...) {
+            return SetErrorFromException(error);
+        }
+    }
+
+    void toiya_cursor_free(toiya_cursor* cursor) {
+        delete cursor;
+    }
+
+    toiya_status toiya_query_arrow(const char* path,
+                                   const toiya_arrow_table* tables,
+                                   size_t table_count,
+                                   const char* query,
+                                   const toiya_read_options* options,
+                                   toiya_stream** out,
+                                   toiya_error* error) {
+        TableStreamsReleaser releaser{tables, table_count};
+        if ((tables == nullptr && table_count != 0) || query == nullptr || out == nullptr) {
+            return SetError(error, TOIYA_ERROR_INVALID_ARGUMENT, "tables, query and out must not be NULL");
+        }
+
+        try {
+            std::vector<ArrowTableInput> inputs;
+            inputs.reserve(table_count);
+            for (size_t i = 0; i < table_count; i++) {
+                if (tables[i].name == nullptr || tables[i].stream == nullptr || tables[i].stream -> release == nullptr) {
+                    return SetError(error, TOIYA_ERROR_INVALID_ARGUMENT, "table name and stream must not be NULL");
+                }
+                inputs.push_back({tables[i].name, tables[i].stream});
+            }
+
+            *out = MakeStreamHandle(query_arrow_with_hyper(path != nullptr ? path : "", inputs, query, ToReadOptions(options)));
+            return SetError(error, TOIYA_OK, "");
+        } catch (...) {
+            return SetErrorFromException(error);
+        }
+    }
+
+    toiya_status toiya_stream_open_prepared(const char* path,
+                                            const char* query,
+                                            const toiya_parameter* parameters,
+                                            size_t parameter_count,
+                                            const toiya_read_options* options,
+                                            toiya_stream** out,
+                                            toiya_error* error) {
+        if (path == nullptr || query == nullptr || (parameters == nullptr && parameter_count != 0) || out == nullptr) {
+            return SetError(error, TOIYA_ERROR_INVALID_ARGUMENT, "path, query, parameters and out must not be NULL");
+        }
+
+        try {
+            std::vector<QueryParameter> bound;
+            bound.reserve(parameter_count);
+            for (size_t i = 0; i < parameter_count; i++) {
+                bound.push_back(ToQueryParameter(parameters[i]));
+            }
+
+            *out = MakeStreamHandle(read_from_hyper_prepared(path, query, bound, ToReadOptions(options)));
+            return SetError(error, TOIYA_OK, "");
+        } catch (...) {
+            return SetErrorFromException(error);
+        }
+    }
+
+    toiya_status toiya_stream_open_late(const char* path,
+                                        const char* query,
+                                        const char* table,
+                                        const char* const* key_columns,
+                                        size_t key_column_count,
+                                        const char* const* columns,
+                                        size_t column_count,
+                                        const toiya_read_options* options,
+                                        toiya_stream** out,
+                                        toiya_error* error) {
+        if (path == nullptr || query == nullptr || table == nullptr || key_columns == nullptr ||
+            (columns == nullptr && column_count != 0) || out == nullptr) {
+            return SetError(error, TOIYA_ERROR_INVALID_ARGUMENT, "path, query, table, key_columns and out must not be NULL");
+        }
+        if (std::find(key_columns, key_columns + key_column_count, nullptr) != key_columns + key_column_count ||
+            (columns != nullptr && std::find(columns, columns + column_count, nullptr) != columns + column_count)) {
+            return SetError(error, TOIYA_ERROR_INVALID_ARGUMENT, "key_columns and columns must not contain NULL");
+        }
+
+        try {
+            LateMaterializationOptions late_options{};
+            late_options.table = table;
+            late_options.key_columns.assign(key_columns, key_columns + key_column_count);
+            if (columns != nullptr) {
+                late_options.columns.assign(columns, columns + column_count);
+            }
+            late_options.read = ToReadOptions(options);
+
+            *out = MakeStreamHandle(read_late_materialized(path, query, late_options));
+            return SetError(error, TOIYA_OK, "");
+        } catch (...) {
+            return SetErrorFromException(error);
+        }
+    }
+
+    toiya_status toiya_stream_open_shards(const char* const* paths,
+                                          size_t path_count,
+                                          const char* query,
+                                          const toiya_read_options* options,
+                                          size_t max_concurrency,
+                                          const char* source_column,
+                                          toiya_stream** out,
+                                          toiya_error* error) {
+        if ((paths == nullptr && path_count != 0) || query == nullptr || out == nullptr) {
+            return SetError(error, TOIYA_ERROR_INVALID_ARGUMENT, "paths, query and out must not be NULL");
+        }
+
+        try {
+            std::vector<std::string> files;
+            for (size_t i = 0; i < path_count; i++) {
+                if (paths[i] == nullptr) {
+                    return SetError(error, TOIYA_ERROR_INVALID_ARGUMENT, "paths must not contain NULL");
+                }
+                const auto expanded = expand_hyper_paths(paths[i]);
+                files.insert(files.end(), expanded.begin(), expanded.end());
+            }
+
+            ShardedReadOptions sharded_options{};
+            sharded_options.max_concurrency = max_concurrency;
+            if (source_column != nullptr) {
+                sharded_options.source_column = source_column;
+            }
+            sharded_options.read = ToReadOptions(options);
+
+            *out = MakeStreamHandle(read_from_hyper_shards(files, query, sharded_options));
+            return SetError(error, TOIYA_OK, "");
+        } catch (...) {
+            return SetErrorFromException(error);
+        }
+    }
+
+    toiya_status toiya_batch_open(const toiya_query* queries,
+                                  size_t query_count,
+                                  const toiya_read_options* options,
+                                  size_t max_concurrency,
+                                  toiya_batch** out,
+                                  toiya_error* error) {
+        if ((queries == nullptr && query_count != 0) || out == nullptr) {
+            return SetError(error, TOIYA_ERROR_INVALID_ARGUMENT, "queries and out must not be NULL");
+        }
+
+        try {
+            std::vector<QuerySpec> specs;
+            specs.reserve(query_count);
+            for (size_t i = 0; i < query_count; i++) {
+                if (queries[i].path == nullptr || queries[i].query == nullptr) {
+                    return SetError(error, TOIYA_ERROR_INVALID_ARGUMENT, "query path and text must not be NULL");
+                }
+                specs.push_back({queries[i].path, queries[i].query});
+            }
+
+            auto batch = std::make_unique<toiya_batch>();
+            batch -> batch = std::make_unique<QueryBatch>(std::move(specs), ToReadOptions(options), max_concurrency);
+
+            *out = batch.release();
+            return SetError(error, TOIYA_OK, "");
+        } catch (...) {
+            return SetErrorFromException(error);
+        }
+    }
+
+    toiya_status toiya_batch_next_ready(toiya_batch* batch,
+                                        size_t* index,
+                                        toiya_stream** stream,
+                                        toiya_error* error) {
+        if (batch == nullptr || index == nullptr || stream == nullptr) {
+            return SetError(error, TOIYA_ERROR_INVALID_ARGUMENT, "batch, index and stream must not be NULL");
+        }
+
+        *stream = nullptr;
+        try {
+            auto ready = batch -> batch -> NextReady();
+            if (!ready) {
+                return SetError(error, TOIYA_OK, "");
+            }
+
+            *index = ready -> index;
+            if (ready -> error) {
+                std::rethrow_exception(ready -> error);
+            }
+
+            *stream = MakeStreamHandle(ready -> result);
+            return SetError(error, TOIYA_OK, "");
+        } catch (...) {
+            return SetErrorFromException(error);
+        }
+    }
+
+    void toiya_batch_free(toiya_batch* batch) {
+        delete batch;
+    }
+
+    void toiya_write_options_init(toiya_write_options* options) {
+        *options = toiya_write_options{};
+        options -> struct_size = sizeof(toiya_write_options);
+    }
+
+    toiya_status toiya_append_arrow(const char* path,
+                                    const char* table,
+                                    struct ArrowArrayStream* stream,
+                                    const toiya_write_options* options,
+                                    int64_t* rows,
+                                    toiya_error* error) {
+        StreamReleaser releaser{stream};
+        if (path == nullptr || table == nullptr || stream == nullptr || stream -> release == nullptr) {
+            return SetError(error, TOIYA_ERROR_INVALID_ARGUMENT, "path, table and stream must not be NULL");
+        }
+
+        try {
+            const auto written = appendArrowToHyper(path, table, stream, ToWriteOptions(options));
+            if (rows != nullptr) {
+                *rows = written;
+            }
+            return SetError(error, TOIYA_OK, "");
+        } catch (...) {
+            return SetErrorFromException(error);
+        }
+    }
+
+    toiya_status toiya_upsert_arrow(const char* path,
+                                    const char* table,
+                                    const char* const* key_columns,
+                                    size_t key_column_count,
+                                    struct ArrowArrayStream* stream,
+                                    const toiya_write_options* options,
+                                    int64_t* rows,
+                                    toiya_error* error) {
+        StreamReleaser releaser{stream};
+        if (path == nullptr || table == nullptr || key_columns == nullptr || stream == nullptr ||
+            stream -> release == nullptr) {
+            return SetError(error, TOIYA_ERROR_INVALID_ARGUMENT, "path, table, key_columns and stream must not be NULL");
+        }
+
+        try {
+            const std::vector<std::string> keys(key_columns, key_columns + key_column_count);
+            const auto written = upsertArrowToHyper(path, table, keys, stream, ToWriteOptions(options));
+            if (rows != nullptr) {
+                *rows = written;
+            }
+            return SetError(error, TOIYA_OK, "");
+        } catch (...) {
+            return SetErrorFromException(error);
+        }
+    }
+}
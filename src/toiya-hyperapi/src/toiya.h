@@ -0,0 +1,434 @@
+#ifndef TOIYA_H
+#define TOIYA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define TOIYA_VERSION_MAJOR 0
+#define TOIYA_VERSION_MINOR 1
+#define TOIYA_VERSION_PATCH 0
+
+// Bumped on every incompatible change to the declarations below. Compare it with
+// toiya_abi_version() to detect a mismatched shared library at runtime.
+#define TOIYA_ABI_VERSION 1
+
+#if defined(_WIN32)
+#if defined(TOIYA_BUILD)
+#define TOIYA_EXPORT __declspec(dllexport)
+#else
+#define TOIYA_EXPORT __declspec(dllimport)
+#endif
+#else
+#define TOIYA_EXPORT __attribute__((visibility("default")))
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Arrow C data and stream interfaces, see https://arrow.apache.org/docs/format/CDataInterface.html
+#ifndef ARROW_C_DATA_INTERFACE
+#define ARROW_C_DATA_INTERFACE
+
+#define ARROW_FLAG_DICTIONARY_ORDERED 1
+#define ARROW_FLAG_NULLABLE 2
+#define ARROW_FLAG_MAP_KEYS_SORTED 4
+
+struct ArrowSchema {
+    const char* format;
+    const char* name;
+    const char* metadata;
+    int64_t flags;
+    int64_t n_children;
+    struct ArrowSchema** children;
+    struct ArrowSchema* dictionary;
+    void (*release)(struct ArrowSchema*);
+    void* private_data;
+};
+
+struct ArrowArray {
+    int64_t length;
+    int64_t null_count;
+    int64_t offset;
+    int64_t n_buffers;
+    int64_t n_children;
+    const void** buffers;
+    struct ArrowArray** children;
+    struct ArrowArray* dictionary;
+    void (*release)(struct ArrowArray*);
+    void* private_data;
+};
+
+#endif // ARROW_C_DATA_INTERFACE
+
+#ifndef ARROW_C_STREAM_INTERFACE
+#define ARROW_C_STREAM_INTERFACE
+
+struct ArrowArrayStream {
+    int (*get_schema)(struct ArrowArrayStream*, struct ArrowSchema* out);
+    int (*get_next)(struct ArrowArrayStream*, struct ArrowArray* out);
+    const char* (*get_last_error)(struct ArrowArrayStream*);
+    void (*release)(struct ArrowArrayStream*);
+    void* private_data;
+};
+
+#endif // ARROW_C_STREAM_INTERFACE
+
+typedef enum {
+    TOIYA_OK = 0,
+    // A handle, path, query or option was not usable.
+    TOIYA_ERROR_INVALID_ARGUMENT = 1,
+    // Hyper failed to open the file, run the query or fetch the result.
+    TOIYA_ERROR_HYPER = 2,
+    // A Hyper value could not be converted into Arrow.
+    TOIYA_ERROR_CONVERSION = 3,
+    TOIYA_ERROR_OUT_OF_MEMORY = 4,
+    TOIYA_ERROR_INTERNAL = 5,
+    // The query was stopped by toiya_stream_cancel or by releasing its stream.
+    TOIYA_ERROR_CANCELLED = 6,
+    // The query ran past toiya_read_options.timeout_ms.
+    TOIYA_ERROR_DEADLINE_EXCEEDED = 7,
+    // The cursor expired after being idle, was closed, or lost its connection.
+    TOIYA_ERROR_CURSOR_CLOSED = 8,
+} toiya_status;
+
+typedef struct {
+    toiya_status code;
+    char message[1024];
+} toiya_error;
+
+// Host supplied allocator for the Arrow buffers of every batch, e.g. jemalloc.
+// reallocate receives NULL for a new allocation. Must stay valid until every batch
+// built with it has been released.
+typedef struct {
+    uint8_t* (*reallocate)(void* private_data, uint8_t* ptr, int64_t old_size, int64_t new_size);
+    void (*free)(void* private_data, uint8_t* ptr, int64_t size);
+    void* private_data;
+} toiya_buffer_allocator;
+
+typedef struct {
+    // Set by toiya_read_options_init. Fields beyond struct_size keep their defaults,
+    // so hosts built against an older header stay compatible.
+    size_t struct_size;
+
+    // Rows per Hyper chunk. 0 keeps Hyper's default chunking.
+    size_t chunk_size;
+    // When non-zero, batches are coalesced or split to land near this many bytes.
+    size_t target_batch_bytes;
+    // Bytes of released batch buffers kept for reuse. 0 disables pooling.
+    size_t buffer_pool_bytes;
+    // Allocator used instead of the pool when not NULL.
+    const toiya_buffer_allocator* allocator;
+
+    // Result columns known to be NOT NULL, named as in the emitted schema.
+    const char* const* not_null_columns;
+    size_t not_null_column_count;
+    // Table whose NOT NULL declarations are applied to the result column of the same
+    // name and type, when only one result column has that name.
+    const char* nullability_table;
+
+    // Directory containing the hyperd executable. NULL searches next to the Hyper
+    // API library. The Hyper process is shared, so only the first stream decides.
+    const char* hyper_path;
+
+    // The query is cancelled when it has not been read to the end within this many
+    // milliseconds of toiya_stream_open. 0 means no deadline.
+    uint64_t timeout_ms;
+
+    // Directory in which finished results are kept as Arrow IPC files and served
+    // from on later identical reads of an unchanged file. NULL disables the cache.
+    const char* cache_dir;
+    // Bytes kept in cache_dir; the least recently used results are evicted beyond it.
+    uint64_t cache_max_bytes;
+
+    // Non-zero collects per column statistics for every batch while decoding, see
+    // toiya_stream_statistics. Such reads bypass the result cache.
+    int compute_statistics;
+
+    // Non-zero reads the whole result as one batch without Hyper's chunked mode,
+    // the fastest path for small results.
+    int single_batch;
+} toiya_read_options;
+
+typedef struct toiya_stream toiya_stream;
+
+TOIYA_EXPORT uint32_t toiya_abi_version(void);
+
+TOIYA_EXPORT void toiya_read_options_init(toiya_read_options* options);
+
+// Runs query against the .hyper file at path. On success *out owns the result until
+// toiya_stream_free. error may be NULL.
+TOIYA_EXPORT toiya_status toiya_stream_open(const char* path,
+                                            const char* query,
+                                            const toiya_read_options* options,
+                                            toiya_stream** out,
+                                            toiya_error* error);
+
+TOIYA_EXPORT toiya_status toiya_stream_get_schema(toiya_stream* stream,
+                                                  struct ArrowSchema* out,
+                                                  toiya_error* error);
+
+// Moves the next batch into out. At the end of the result out->release is set to NULL.
+TOIYA_EXPORT toiya_status toiya_stream_next(toiya_stream* stream,
+                                            struct ArrowArray* out,
+                                            toiya_error* error);
+
+// Moves the remaining result into an ArrowArrayStream owned by the caller. The handle
+// must still be freed, but yields no further batches.
+TOIYA_EXPORT toiya_status toiya_stream_export(toiya_stream* stream,
+                                              struct ArrowArrayStream* out,
+                                              toiya_error* error);
+
+// Cancels the running query. Safe to call from another thread while toiya_stream_next
+// is blocked, which then fails with TOIYA_ERROR_CANCELLED; not safe to call
+// concurrently with toiya_stream_free. Also reaches streams that have been exported.
+TOIYA_EXPORT void toiya_stream_cancel(toiya_stream* stream);
+
+// Releasing a stream that has not been read to the end cancels its query.
+TOIYA_EXPORT void toiya_stream_free(toiya_stream* stream);
+
+typedef enum {
+    // The batch had no non-null value, or the column type has no order here
+    // (intervals, decimals).
+    TOIYA_STATISTICS_NONE = 0,
+    // Integers, booleans and the storage values of dates (days), timestamps and
+    // times (microseconds).
+    TOIYA_STATISTICS_INT = 1,
+    // Floating point columns; NaN is left out of the bounds.
+    TOIYA_STATISTICS_DOUBLE = 2,
+    // Strings and binaries, compared bytewise.
+    TOIYA_STATISTICS_BYTES = 3,
+} toiya_statistics_kind;
+
+typedef struct {
+    int64_t null_count;
+    // HyperLogLog estimate, within a few percent.
+    int64_t distinct_estimate;
+    // Selects which pair of bounds below is set.
+    toiya_statistics_kind kind;
+    int64_t min_int;
+    int64_t max_int;
+    double min_double;
+    double max_double;
+    const uint8_t* min_bytes;
+    int64_t min_bytes_size;
+    const uint8_t* max_bytes;
+    int64_t max_bytes_size;
+} toiya_column_statistics;
+
+// Statistics of the batch last returned by toiya_stream_next, or by the exported
+// stream, one entry per column. Requires toiya_read_options.compute_statistics.
+// *statistics stays valid until the next batch is read or the stream is freed;
+// *column_count is 0 before the first batch and after the last.
+TOIYA_EXPORT toiya_status toiya_stream_statistics(toiya_stream* stream,
+                                                  const toiya_column_statistics** statistics,
+                                                  size_t* column_count,
+                                                  toiya_error* error);
+
+// Previews return a stream holding a single batch of at most rows rows. When percent
+// is non-zero, about that percentage of the rows is sampled; rows 0 then means no
+// row limit. Batching fields of options are ignored.
+
+// Samples table with TABLESAMPLE, which skips whole blocks of the table. table may
+// be qualified with its schema and quoted as in SQL, e.g. "Extract"."Extract".
+TOIYA_EXPORT toiya_status toiya_preview_table(const char* path,
+                                              const char* table,
+                                              size_t rows,
+                                              double percent,
+                                              const toiya_read_options* options,
+                                              toiya_stream** out,
+                                              toiya_error* error);
+
+// Previews the result of query, stopping it once rows rows have been produced.
+TOIYA_EXPORT toiya_status toiya_preview_query(const char* path,
+                                              const char* query,
+                                              size_t rows,
+                                              double percent,
+                                              const toiya_read_options* options,
+                                              toiya_stream** out,
+                                              toiya_error* error);
+
+typedef struct toiya_cursor toiya_cursor;
+
+// Runs query once and keeps its result in a numbered temporary table, so that any
+// row range can be fetched without running it again. order_by (may be NULL) fixes
+// the row numbering, e.g. "price DESC, id". The cursor closes itself after
+// idle_timeout_ms without a fetch; 0 keeps it until toiya_cursor_free.
+TOIYA_EXPORT toiya_status toiya_cursor_open(const char* path,
+                                            const char* query,
+                                            const char* order_by,
+                                            uint64_t idle_timeout_ms,
+                                            const toiya_read_options* options,
+                                            toiya_cursor** out,
+                                            toiya_error* error);
+
+TOIYA_EXPORT toiya_status toiya_cursor_row_count(toiya_cursor* cursor,
+                                                 int64_t* row_count,
+                                                 toiya_error* error);
+
+// Rows [offset, offset + count) as a stream of at most one batch. Fetches of one
+// cursor are serialized. The timeout_ms of the options given to toiya_cursor_open
+// bounds the query and, separately, every fetch; a fetch that runs out of time fails
+// with TOIYA_ERROR_DEADLINE_EXCEEDED but leaves the cursor open.
+TOIYA_EXPORT toiya_status toiya_cursor_fetch(toiya_cursor* cursor,
+                                             int64_t offset,
+                                             int64_t count,
+                                             toiya_stream** out,
+                                             toiya_error* error);
+
+TOIYA_EXPORT void toiya_cursor_free(toiya_cursor* cursor);
+
+typedef struct {
+    // Name under which the query refers to the data.
+    const char* name;
+    struct ArrowArrayStream* stream;
+} toiya_arrow_table;
+
+// Loads each table into a temporary table on a dedicated connection and runs query
+// over them, with the .hyper file at path attached as the default database. path
+// may be NULL to query the tables alone. The table streams are consumed and
+// released, also on failure; the temporary tables are dropped with *out.
+TOIYA_EXPORT toiya_status toiya_query_arrow(const char* path,
+                                            const toiya_arrow_table* tables,
+                                            size_t table_count,
+                                            const char* query,
+                                            const toiya_read_options* options,
+                                            toiya_stream** out,
+                                            toiya_error* error);
+
+// Runs query against every file in paths and merges the results into one stream,
+// reading at most max_concurrency files at a time. An entry whose file name
+// contains * or ? is expanded to the matching files. Every file must produce the
+// same schema. source_column may be NULL; otherwise each batch gets a trailing
+// dictionary encoded column of that name holding its file path. A timeout in
+// options covers the whole read. toiya_stream_cancel and freeing the stream stop
+// the remaining reads.
+TOIYA_EXPORT toiya_status toiya_stream_open_shards(const char* const* paths,
+                                                   size_t path_count,
+                                                   const char* query,
+                                                   const toiya_read_options* options,
+                                                   size_t max_concurrency,
+                                                   const char* source_column,
+                                                   toiya_stream** out,
+                                                   toiya_error* error);
+
+typedef enum {
+    TOIYA_PARAMETER_BOOL = 0,
+    TOIYA_PARAMETER_BIGINT = 1,
+    TOIYA_PARAMETER_DOUBLE = 2,
+    TOIYA_PARAMETER_TEXT = 3,
+    TOIYA_PARAMETER_DATE = 4,
+    TOIYA_PARAMETER_TIMESTAMP = 5,
+    TOIYA_PARAMETER_TIMESTAMP_TZ = 6,
+} toiya_parameter_type;
+
+typedef struct {
+    toiya_parameter_type type;
+    // Non-zero binds NULL; the values below are ignored.
+    int is_null;
+    // Value of BOOL (0 or 1) and BIGINT parameters.
+    int64_t int_value;
+    // Value of DOUBLE parameters.
+    double double_value;
+    // Value of TEXT parameters, and of DATE and TIMESTAMP ones in ISO 8601 format.
+    const char* text_value;
+} toiya_parameter;
+
+// Runs query with $1, $2, ... bound to parameters as a prepared statement on a
+// pooled connection. Each connection prepares a query once per parameter types and
+// reuses the statement on later calls. Set options->single_batch for small results.
+TOIYA_EXPORT toiya_status toiya_stream_open_prepared(const char* path,
+                                                     const char* query,
+                                                     const toiya_parameter* parameters,
+                                                     size_t parameter_count,
+                                                     const toiya_read_options* options,
+                                                     toiya_stream** out,
+                                                     toiya_error* error);
+
+// Reads the rows selected by query in two phases. query returns the key_columns of
+// table plus whatever it filters or sorts by; each of its batches is then extended
+// with the columns of the same rows of table, looked up by key, or with every
+// column of table it lacks when columns is NULL. Wide columns are thus only read for
+// the rows that survive. Every key must match exactly one row of table, which may
+// be schema qualified as for toiya_preview_table. Such streams have no statistics;
+// compute_statistics in options is ignored.
+TOIYA_EXPORT toiya_status toiya_stream_open_late(const char* path,
+                                                 const char* query,
+                                                 const char* table,
+                                                 const char* const* key_columns,
+                                                 size_t key_column_count,
+                                                 const char* const* columns,
+                                                 size_t column_count,
+                                                 const toiya_read_options* options,
+                                                 toiya_stream** out,
+                                                 toiya_error* error);
+
+typedef struct {
+    const char* path;
+    const char* query;
+} toiya_query;
+
+typedef struct toiya_batch toiya_batch;
+
+// Starts query_count independent queries on pooled connections, at most
+// max_concurrency of them at a time. A query counts as running until Hyper has
+// delivered its first chunk, so handed out streams may be kept unread while the
+// remaining queries start. The queries are copied.
+TOIYA_EXPORT toiya_status toiya_batch_open(const toiya_query* queries,
+                                           size_t query_count,
+                                           const toiya_read_options* options,
+                                           size_t max_concurrency,
+                                           toiya_batch** out,
+                                           toiya_error* error);
+
+// Waits for the next query whose first batch is ready, in completion order, and
+// stores its position in *index. A failed query returns its error with *stream set
+// to NULL; later calls continue with the remaining queries. Once every query has
+// been handed out, TOIYA_OK is returned with *stream set to NULL.
+TOIYA_EXPORT toiya_status toiya_batch_next_ready(toiya_batch* batch,
+                                                 size_t* index,
+                                                 toiya_stream** stream,
+                                                 toiya_error* error);
+
+// Waits for running queries to start and releases the streams not handed out yet.
+TOIYA_EXPORT void toiya_batch_free(toiya_batch* batch);
+
+typedef struct {
+    // Set by toiya_write_options_init, see toiya_read_options.
+    size_t struct_size;
+
+    // Rows per transaction. 0 writes the whole stream in one transaction.
+    int64_t commit_rows;
+    // Directory containing the hyperd executable, see toiya_read_options.
+    const char* hyper_path;
+} toiya_write_options;
+
+TOIYA_EXPORT void toiya_write_options_init(toiya_write_options* options);
+
+// Appends stream to the existing table in the .hyper file at path, matching Arrow
+// columns to table columns by name. The stream is consumed and released, also on
+// failure. rows may be NULL; otherwise it receives the number of rows written.
+// table is parsed like the table of toiya_preview_table.
+TOIYA_EXPORT toiya_status toiya_append_arrow(const char* path,
+                                             const char* table,
+                                             struct ArrowArrayStream* stream,
+                                             const toiya_write_options* options,
+                                             int64_t* rows,
+                                             toiya_error* error);
+
+// Like toiya_append_arrow, but replaces the rows whose key columns equal those of an
+// incoming row. Each commit is applied atomically.
+TOIYA_EXPORT toiya_status toiya_upsert_arrow(const char* path,
+                                             const char* table,
+                                             const char* const* key_columns,
+                                             size_t key_column_count,
+                                             struct ArrowArrayStream* stream,
+                                             const toiya_write_options* options,
+                                             int64_t* rows,
+                                             toiya_error* error);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // TOIYA_H
@@ -0,0 +1,179 @@
+// toiya-export: streams a query result from a .hyper file into an Arrow IPC stream
+// file, one batch at a time, so memory stays bounded by the batch size.
+//
+//   toiya-export [--chunk-size ROWS] [--batch-bytes BYTES] FILE.hyper QUERY OUTPUT
+//
+// OUTPUT "-" writes to stdout. Progress goes to stderr.
+
+#include "toiya.h"
+
+#include <chrono>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <nanoarrow/nanoarrow.hpp>
+#include <nanoarrow/nanoarrow_ipc.h>
+
+namespace {
+    constexpr auto kProgressInterval = std::chrono::seconds(1);
+
+    struct CountingOutput {
+        FILE* file;
+        int64_t bytes_written;
+    };
+
+    // Forwards to file and counts the bytes for the throughput report.
+    auto InitCountingOutputStream(struct ArrowIpcOutputStream* stream, CountingOutput* output) -> void {
+        stream -> write = [](struct ArrowIpcOutputStream* stream, const void* buf, int64_t size_bytes,
+                             int64_t* size_written_out, struct ArrowError* error) -> ArrowErrorCode {
+            auto output = static_cast<CountingOutput*>(stream -> private_data);
+            const auto written = std::fwrite(buf, 1, static_cast<size_t>(size_bytes), output -> file);
+            output -> bytes_written += static_cast<int64_t>(written);
+            *size_written_out = static_cast<int64_t>(written);
+            if (written != static_cast<size_t>(size_bytes)) {
+                ArrowErrorSet(error, "write failed: %s", std::strerror(errno));
+                return EIO;
+            }
+            return NANOARROW_OK;
+        };
+        stream -> release = [](struct ArrowIpcOutputStream* stream) {
+            stream -> release = nullptr;
+        };
+        stream -> private_data = output;
+    }
+
+    class Progress {
+    public:
+        auto Update(int64_t rows, int64_t batches, int64_t bytes, bool done) -> void {
+            const auto now = std::chrono::steady_clock::now();
+            if (!done && now - last_report_ < kProgressInterval) {
+                return;
+            }
+            last_report_ = now;
+
+            const auto seconds = std::chrono::duration<double>(now - start_).count();
+            const auto mib = static_cast<double>(bytes) / (1024.0 * 1024.0);
+            std::fprintf(stderr, "%s%lld rows, %lld batches, %.1f MiB in %.1f s (%.0f rows/s, %.1f MiB/s)%s",
+                         done ? "\rexported " : "\r", static_cast<long long>(rows), static_cast<long long>(batches),
+                         mib, seconds, seconds > 0 ? static_cast<double>(rows) / seconds : 0.0,
+                         seconds > 0 ? mib / seconds : 0.0, done ? "\n" : "");
+            std::fflush(stderr);
+        }
+
+    private:
+        std::chrono::steady_clock::time_point start_ = std::chrono::steady_clock::now();
+        std::chrono::steady_clock::time_point last_report_ = start_;
+    };
+
+    auto Usage(const char* program) -> int {
+        std::fprintf(stderr, "usage: %s [--chunk-size ROWS] [--batch-bytes BYTES] FILE.hyper QUERY OUTPUT\n", program);
+        return 2;
+    }
+
+    auto Fail(const char* what, const char* message) -> int {
+        std::fprintf(stderr, "\n%s: %s\n", what, message);
+        return 1;
+    }
+}
+
+int main(int argc, char** argv) {
+    toiya_read_options options;
+    toiya_read_options_init(&options);
+
+    std::vector<const char*> positional;
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        if ((arg == "--chunk-size" || arg == "--batch-bytes") && i + 1 < argc) {
+            const auto value = std::strtoull(argv[++i], nullptr, 10);
+            (arg == "--chunk-size" ? options.chunk_size : options.target_batch_bytes) = value;
+        } else if (arg.starts_with("--")) {
+            return Usage(argv[0]);
+        } else {
+            positional.push_back(argv[i]);
+        }
+    }
+    if (positional.size() != 3) {
+        return Usage(argv[0]);
+    }
+
+    // Batches are written and released one by one, so nothing is gained by caching
+    // their buffers beyond a single batch.
+    options.buffer_pool_bytes = 0;
+
+    toiya_error error;
+    toiya_stream* stream = nullptr;
+    if (toiya_stream_open(positional[0], positional[1], &options, &stream, &error) != TOIYA_OK) {
+        return Fail("query failed", error.message);
+    }
+
+    const bool to_stdout = std::strcmp(positional[2], "-") == 0;
+    CountingOutput output{to_stdout ? stdout : std::fopen(positional[2], "wb"), 0};
+    if (output.file == nullptr) {
+        toiya_stream_free(stream);
+        return Fail("cannot open output", std::strerror(errno));
+    }
+
+    int status = 0;
+    {
+        nanoarrow::UniqueSchema schema;
+        nanoarrow::UniqueArrayView view;
+        struct ArrowIpcOutputStream output_stream {};
+        struct ArrowIpcWriter writer {};
+        struct ArrowError arrow_error {};
+
+        InitCountingOutputStream(&output_stream, &output);
+        if (ArrowIpcWriterInit(&writer, &output_stream) != NANOARROW_OK) {
+            status = Fail("cannot start writer", "ArrowIpcWriterInit failed");
+        } else if (toiya_stream_get_schema(stream, schema.get(), &error) != TOIYA_OK) {
+            status = Fail("query failed", error.message);
+        } else if (ArrowArrayViewInitFromSchema(view.get(), schema.get(), &arrow_error) != NANOARROW_OK ||
+                   ArrowIpcWriterWriteSchema(&writer, schema.get(), &arrow_error) != NANOARROW_OK) {
+            status = Fail("write failed", arrow_error.message);
+        }
+
+        Progress progress;
+        int64_t rows = 0;
+        int64_t batches = 0;
+        while (status == 0) {
+            nanoarrow::UniqueArray array;
+            if (toiya_stream_next(stream, array.get(), &error) != TOIYA_OK) {
+                status = Fail("query failed", error.message);
+                break;
+            }
+
+            if (array -> release == nullptr) {
+                if (ArrowIpcWriterWriteArrayView(&writer, nullptr, &arrow_error) != NANOARROW_OK) {
+                    status = Fail("write failed", arrow_error.message);
+                    break;
+                }
+                progress.Update(rows, batches, output.bytes_written, true);
+                break;
+            }
+
+            if (ArrowArrayViewSetArray(view.get(), array.get(), &arrow_error) != NANOARROW_OK ||
+                ArrowIpcWriterWriteArrayView(&writer, view.get(), &arrow_error) != NANOARROW_OK) {
+                status = Fail("write failed", arrow_error.message);
+                break;
+            }
+
+            rows += array -> length;
+            batches++;
+            progress.Update(rows, batches, output.bytes_written, false);
+        }
+
+        if (writer.private_data != nullptr) {
+            ArrowIpcWriterReset(&writer);
+        }
+    }
+
+    toiya_stream_free(stream);
+    if (!to_stdout && std::fclose(output.file) != 0 && status == 0) {
+        status = Fail("cannot close output", std::strerror(errno));
+    }
+
+    return status;
+}